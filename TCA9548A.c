@@ -1,32 +1,75 @@
 #include "TCA9548A.h"
+#include "iic_profile.h"
 #include <libpynq.h>
 
 /* low-level write to the control register (pointer = 0x00) */
 static int write_control(iic_index_t iic, uint8_t ctrl)
 {
-    return iic_write_register(iic, TCA9548A_I2C_ADDR, 0x00, &ctrl, 1);
+    return IIC_WRITE(iic, TCA9548A_I2C_ADDR, 0x00, &ctrl, 1);
+}
+
+/* write a new channel mask unless it is already active */
+static int apply_mask(tca9548a *mux, uint8_t mask)
+{
+    if (mux->cached && mux->current_mask == mask) return 0;
+
+    int err = write_control(mux->iic_index, mask);
+    if (err) { tca9548a_invalidate(mux); return err; }
+
+    mux->current_mask = mask;
+    mux->cached       = 1;
+    /* a single channel is also reported as current_channel */
+    mux->current_channel = 0xFF;
+    for (uint8_t ch = 0; ch < TCA9548A_CHANNEL_COUNT; ch++)
+        if (mask == (1u << ch)) mux->current_channel = ch;
+    return 0;
 }
 
 int tca9548a_init(iic_index_t iic, tca9548a *mux)
 {
     if (!mux) return 1;
-    mux->iic_index       = iic;
-    mux->current_channel = 0xFF;          /* none selected */
-    return write_control(iic, 0x00);      /* disable all channels */
+    mux->iic_index = iic;
+    tca9548a_invalidate(mux);
+    return apply_mask(mux, 0x00);         /* disable all channels */
 }
 
 int tca9548a_destroy(tca9548a *mux)
 {
     if (!mux) return 1;
-    mux->current_channel = 0xFF;
+    tca9548a_invalidate(mux);
     return write_control(mux->iic_index, 0x00);
 }
 
 int tca9548a_select_channel(tca9548a *mux, uint8_t channel)
 {
     if (!mux || channel >= TCA9548A_CHANNEL_COUNT) return 1;
-    uint8_t ctrl = 1u << channel;
-    int err = write_control(mux->iic_index, ctrl);
-    if (!err) mux->current_channel = channel;
-    return err;
+    return apply_mask(mux, (uint8_t)(1u << channel));
+}
+
+int tca9548a_select_mask(tca9548a *mux, uint8_t mask)
+{
+    if (!mux) return 1;
+    return apply_mask(mux, mask);
+}
+
+int tca9548a_with_channel(tca9548a *mux, uint8_t channel,
+                          int (*fn)(void *ctx), void *ctx)
+{
+    if (!mux || !fn) return 1;
+    uint8_t saved  = mux->current_mask;
+    uint8_t known  = mux->cached;
+
+    if (tca9548a_select_channel(mux, channel)) return 1;
+    int result = fn(ctx);
+    /* an unknown previous state cannot be restored; leave the channel */
+    if (known) apply_mask(mux, saved);
+    return result;
+}
+
+void tca9548a_invalidate(tca9548a *mux)
+{
+    if (!mux) return;
+    mux->current_channel = 0xFF;
+    mux->current_mask    = 0x00;
+    mux->cached          = 0;
 }
@@ -11,12 +11,27 @@
 /* Handle for one TCA9548A device */
 typedef struct tca9548a_mux {
     iic_index_t iic_index;     /* which I²C bus to use           */
-    uint8_t     current_channel;  /* last-selected channel 0-7, 0xFF = none */
+    uint8_t     current_channel;  /* last-selected channel 0-7, 0xFF = none / several */
+    uint8_t     current_mask;     /* enabled channels, bit n = channel n */
+    uint8_t     cached;           /* current_mask matches the chip, writes can be skipped */
 } tca9548a;
 
-/* API – exactly as in the original file */
+/* Basic API; select_channel writes only when the selection changes */
 int tca9548a_init          (iic_index_t iic, tca9548a *mux);
 int tca9548a_destroy       (tca9548a *mux);
 int tca9548a_select_channel(tca9548a *mux, uint8_t channel);
 
+/* Enable several downstream buses at once (devices need distinct addresses).
+ * Like select_channel, nothing is written when the mask is already active. */
+int tca9548a_select_mask   (tca9548a *mux, uint8_t mask);
+
+/* Select `channel`, run fn(ctx), then restore the previous selection.
+ * Returns fn's result, or 1 if the channel could not be selected. */
+int tca9548a_with_channel  (tca9548a *mux, uint8_t channel,
+                            int (*fn)(void *ctx), void *ctx);
+
+/* Forget the cached selection, e.g. after a bus error or a mux reset;
+ * the next select always writes the control register. */
+void tca9548a_invalidate   (tca9548a *mux);
+
 #endif /* TCA9548A_H */
@@ -0,0 +1,111 @@
+#include "cmd_queue.h"
+
+#include <string.h>
+
+int cmd_queue_init(cmd_queue *q)
+{
+    if (!q) return 1;
+    memset(q, 0, sizeof(*q));
+    if (pthread_mutex_init(&q->lock, NULL)) return 1;
+    return pthread_cond_init(&q->ready, NULL) != 0;
+}
+
+void cmd_queue_destroy(cmd_queue *q)
+{
+    if (!q) return;
+    pthread_cond_destroy(&q->ready);
+    pthread_mutex_destroy(&q->lock);
+}
+
+int cmd_queue_push(cmd_queue *q, const queued_move *mv)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->tail - q->head == CMD_QUEUE_DEPTH) {
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    q->item[q->tail++ % CMD_QUEUE_DEPTH] = *mv;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+int cmd_queue_pop(cmd_queue *q, queued_move *mv)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->head == q->tail && !q->closed)
+        pthread_cond_wait(&q->ready, &q->lock);
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    *mv = q->item[q->head++ % CMD_QUEUE_DEPTH];
+    mv->epoch = q->epoch;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+int cmd_queue_try_pop(cmd_queue *q, queued_move *mv)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->head == q->tail) {
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    *mv = q->item[q->head++ % CMD_QUEUE_DEPTH];
+    mv->epoch = q->epoch;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static uint32_t flush_locked(cmd_queue *q, queued_move *dropped, uint32_t max)
+{
+    uint32_t n = 0;
+    while (q->head != q->tail) {
+        queued_move *mv = &q->item[q->head++ % CMD_QUEUE_DEPTH];
+        if (dropped && n < max) dropped[n] = *mv;
+        n++;
+    }
+    return n;
+}
+
+uint32_t cmd_queue_flush(cmd_queue *q, queued_move *dropped, uint32_t max)
+{
+    pthread_mutex_lock(&q->lock);
+    uint32_t n = flush_locked(q, dropped, max);
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+uint32_t cmd_queue_cancel(cmd_queue *q, queued_move *dropped, uint32_t max)
+{
+    pthread_mutex_lock(&q->lock);
+    uint32_t n = flush_locked(q, dropped, max);
+    q->epoch++;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+int cmd_queue_cancelled(cmd_queue *q, const queued_move *mv)
+{
+    pthread_mutex_lock(&q->lock);
+    int cancelled = mv->epoch != q->epoch;
+    pthread_mutex_unlock(&q->lock);
+    return cancelled;
+}
+
+uint32_t cmd_queue_count(cmd_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    uint32_t n = q->tail - q->head;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+void cmd_queue_close(cmd_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
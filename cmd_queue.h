@@ -0,0 +1,65 @@
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Bounded queue of move commands.
+ *
+ * The receive path pushes moves while an executor pops and runs them, so
+ * the host can stream moves ahead of the one being driven. Every flush
+ * or cancel returns the dropped moves so each can be acknowledged; cancel
+ * also bumps the epoch, which tells the executor to stop a move it popped
+ * before the cancel.
+ */
+
+#define CMD_QUEUE_DEPTH 8
+
+typedef struct queued_move {
+    uint16_t id;              /* host's command id           */
+    uint16_t speed;
+    int16_t  left, right;
+    uint8_t  binary;          /* answer with msg.h messages  */
+    uint8_t  version;         /* msg.h layout of the command */
+    uint32_t epoch;           /* set by cmd_queue_pop        */
+} queued_move;
+
+/* Queue handle, do not modify directly */
+typedef struct cmd_queue {
+    queued_move     item[CMD_QUEUE_DEPTH];
+    uint32_t        head, tail;
+    uint32_t        epoch;
+    int             closed;
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+} cmd_queue;
+
+int  cmd_queue_init(cmd_queue *q);
+void cmd_queue_destroy(cmd_queue *q);
+
+/* Returns 1 when the queue is full (the move is not queued) */
+int  cmd_queue_push(cmd_queue *q, const queued_move *mv);
+
+/* Block until a move is queued; returns 1 once the queue is closed */
+int  cmd_queue_pop(cmd_queue *q, queued_move *mv);
+
+/* cmd_queue_pop without waiting; returns 1 when nothing is queued */
+int  cmd_queue_try_pop(cmd_queue *q, queued_move *mv);
+
+/* Drop all queued moves, copying up to max of them to dropped (may be
+ * NULL). Returns how many were dropped. */
+uint32_t cmd_queue_flush(cmd_queue *q, queued_move *dropped, uint32_t max);
+
+/* cmd_queue_flush, and mark moves popped so far as cancelled */
+uint32_t cmd_queue_cancel(cmd_queue *q, queued_move *dropped, uint32_t max);
+
+/* 1 if a popped move was cancelled since it was popped */
+int  cmd_queue_cancelled(cmd_queue *q, const queued_move *mv);
+
+uint32_t cmd_queue_count(cmd_queue *q);
+
+/* Wake cmd_queue_pop for good */
+void cmd_queue_close(cmd_queue *q);
+
+#endif /* CMD_QUEUE_H */
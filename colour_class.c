@@ -0,0 +1,61 @@
+#include "colour_class.h"
+
+#include <math.h>
+#include <string.h>
+
+static const char *class_names[COLOUR_CLASSES] = {"unknown", "black", "white", "red", "green", "blue"};
+
+/* log2(COLOUR_LUT_MIN_CLEAR) in half octaves */
+#define MIN_CLEAR_HALF_OCTAVES 12
+
+/* Every channel gets one count added, so an all-zero reading falls in the
+ * neutral cell instead of dividing by zero, and r/(r+g+b) stays below 1. */
+uint32_t colour_lut_index(const tcsReading *rgb)
+{
+    uint32_t r = rgb->red + 1u, g = rgb->green + 1u, b = rgb->blue + 1u;
+    uint32_t sum = r + g + b;
+    uint32_t ri = r * COLOUR_LUT_CHROMA / sum;
+    uint32_t gi = g * COLOUR_LUT_CHROMA / sum;
+
+    /* half octaves: the top bit, then whether the next one is set */
+    uint32_t c = rgb->clear + 1u;
+    int msb = 31 - __builtin_clz(c);
+    int level = 2 * msb + (int)(((c << 1) >> msb) & 1u) - MIN_CLEAR_HALF_OCTAVES;
+    level = level < 0 ? 0 : level;
+    level = level >= COLOUR_LUT_BRIGHT ? COLOUR_LUT_BRIGHT - 1 : level;
+
+    return ((uint32_t)level * COLOUR_LUT_CHROMA + ri) * COLOUR_LUT_CHROMA + gi;
+}
+
+void colour_lut_centre(uint32_t index, float *r, float *g, float *log2_clear)
+{
+    uint32_t gi = index % COLOUR_LUT_CHROMA;
+    uint32_t ri = index / COLOUR_LUT_CHROMA % COLOUR_LUT_CHROMA;
+    uint32_t level = index / (COLOUR_LUT_CHROMA * COLOUR_LUT_CHROMA) + MIN_CLEAR_HALF_OCTAVES;
+
+    *r = (ri + 0.5f) / COLOUR_LUT_CHROMA;
+    *g = (gi + 0.5f) / COLOUR_LUT_CHROMA;
+    /* [1, 1.5) or [1.5, 2) times 2^(level / 2) */
+    *log2_clear = (float)(level / 2) + log2f((level & 1) ? 1.75f : 1.25f);
+}
+
+colour_class colour_classify(const tcsReading *rgb, uint8_t *confidence)
+{
+    uint8_t e = colour_lut[colour_lut_index(rgb)];
+    colour_class k = (colour_class)(e >> COLOUR_LUT_CLASS_SHIFT);
+    if (confidence) *confidence = (uint8_t)((e & COLOUR_LUT_CONF_MAX) * 100u / COLOUR_LUT_CONF_MAX);
+    if (k == COLOUR_UNKNOWN && rgb->clear < COLOUR_DARK_CLEAR) k = COLOUR_BLACK;
+    return k;
+}
+
+const char *colour_class_name(colour_class c)
+{
+    return (unsigned)c < COLOUR_CLASSES ? class_names[c] : "unknown";
+}
+
+colour_class colour_class_from_name(const char *name)
+{
+    for (int i = 0; i < COLOUR_CLASSES; i++)
+        if (!strcmp(name, class_names[i])) return (colour_class)i;
+    return COLOUR_UNKNOWN;
+}
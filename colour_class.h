@@ -0,0 +1,65 @@
+#ifndef COLOUR_CLASS_H
+#define COLOUR_CLASS_H
+
+#include <stdint.h>
+#include "tcs3472.h"
+
+/*
+ * Floor colour classifier shared by the robot programs.
+ *
+ * A reading is reduced to three features: its chromaticity r/(r+g+b) and
+ * g/(r+g+b), each quantised to COLOUR_LUT_CHROMA steps, and its CLEAR
+ * brightness in half-octave steps from COLOUR_LUT_MIN_CLEAR. Those index
+ * colour_lut, which holds the class and a confidence per cell, so the
+ * class no longer depends on hand-tuned thresholds and a dim red is still
+ * red while only a dark, grey reading is black.
+ *
+ * Readings are expected in tcs_normalise units (auto exposure on), so the
+ * brightness axis means the same at every gain and integration time.
+ *
+ * colour_lut.c is generated by the "Colour calibration" tool from
+ * labelled samples; re-run it after changing sensors or lighting.
+ *
+ * Each colour_lut entry is  class << COLOUR_LUT_CLASS_SHIFT | confidence,
+ * confidence 0..COLOUR_LUT_CONF_MAX.
+ */
+
+#define COLOUR_LUT_CHROMA      16     /* steps of r/(r+g+b) and g/(r+g+b) */
+#define COLOUR_LUT_BRIGHT      16     /* half-octave steps of CLEAR       */
+#define COLOUR_LUT_MIN_CLEAR   64     /* bottom of brightness step 0      */
+#define COLOUR_LUT_SIZE        (COLOUR_LUT_BRIGHT * COLOUR_LUT_CHROMA * COLOUR_LUT_CHROMA)
+#define COLOUR_LUT_CLASS_SHIFT 5
+#define COLOUR_LUT_CONF_MAX    31
+#define COLOUR_DARK_CLEAR      1000   /* darker and unknown: black     */
+
+/* same order and names as msg_colour */
+typedef enum {
+    COLOUR_UNKNOWN = 0,
+    COLOUR_BLACK,
+    COLOUR_WHITE,
+    COLOUR_RED,
+    COLOUR_GREEN,
+    COLOUR_BLUE,
+    COLOUR_CLASSES
+} colour_class;
+
+extern const uint8_t colour_lut[COLOUR_LUT_SIZE];
+
+/* Class of a normalised reading. confidence (may be NULL) gets 0-100:
+ * how much more likely this class was than the others in calibration,
+ * 0 for COLOUR_UNKNOWN. A reading darker than COLOUR_DARK_CLEAR that the
+ * table has no class for is COLOUR_BLACK with confidence 0, so a crater
+ * the calibration samples did not cover is still avoided. */
+colour_class colour_classify(const tcsReading *rgb, uint8_t *confidence);
+
+/* colour_lut index of a reading */
+uint32_t     colour_lut_index(const tcsReading *rgb);
+
+/* Feature values at the centre of a colour_lut cell: chromaticities r, g
+ * in 0..1 and log2 of CLEAR. */
+void         colour_lut_centre(uint32_t index, float *r, float *g, float *log2_clear);
+
+const char  *colour_class_name(colour_class c);
+colour_class colour_class_from_name(const char *name);
+
+#endif /* COLOUR_CLASS_H */
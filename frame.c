@@ -0,0 +1,119 @@
+#include "frame.h"
+
+#include <string.h>
+
+enum { HUNT_SYNC0, HUNT_SYNC1, HEADER, PAYLOAD, TRAILER };
+
+uint8_t frame_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+size_t frame_encode(uint8_t *out, size_t cap, uint8_t seq, const void *payload, uint16_t len)
+{
+    if (len > FRAME_MAX_PAYLOAD || cap < (size_t)len + FRAME_OVERHEAD) return 0;
+
+    out[0] = FRAME_SYNC0;
+    out[1] = FRAME_SYNC1;
+    out[2] = seq;
+    out[3] = (uint8_t)(len >> 8);
+    out[4] = (uint8_t)len;
+    out[5] = frame_crc8(out + 2, 3);
+    if (len && out + FRAME_HEADER != payload) memmove(out + FRAME_HEADER, payload, len);
+
+    uint16_t crc = frame_crc16(0xFFFF, out + 2, 3);
+    crc = frame_crc16(crc, out + FRAME_HEADER, len);
+    out[FRAME_HEADER + len]     = (uint8_t)(crc >> 8);
+    out[FRAME_HEADER + len + 1] = (uint8_t)crc;
+    return (size_t)len + FRAME_OVERHEAD;
+}
+
+void frame_parser_init(frame_parser *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->state = HUNT_SYNC0;
+}
+
+/* count the frames missing between the previous good frame and this one */
+static void frame_done(frame_parser *p)
+{
+    uint8_t seq = p->hdr[2];
+    if (p->have_seq) p->stats.dropped += (uint8_t)(seq - p->seq - 1);
+    p->seq = seq;
+    p->have_seq = 1;
+    p->stats.frames++;
+}
+
+int frame_parser_feed(frame_parser *p, uint8_t byte)
+{
+    switch (p->state) {
+    case HUNT_SYNC0:
+        if (byte == FRAME_SYNC0) { p->hdr[0] = byte; p->state = HUNT_SYNC1; }
+        else p->stats.skipped++;
+        return FRAME_MORE;
+
+    case HUNT_SYNC1:
+        if (byte == FRAME_SYNC1) { p->hdr[1] = byte; p->pos = 2; p->state = HEADER; }
+        else if (byte == FRAME_SYNC0) p->stats.skipped++;   /* A5 A5 5A */
+        else { p->stats.skipped += 2; p->state = HUNT_SYNC0; }
+        return FRAME_MORE;
+
+    case HEADER:
+        p->hdr[p->pos++] = byte;
+        if (p->pos < FRAME_HEADER) return FRAME_MORE;
+
+        p->len = (uint16_t)((p->hdr[3] << 8) | p->hdr[4]);
+        if (frame_crc8(p->hdr + 2, 3) != p->hdr[5] || p->len > FRAME_MAX_PAYLOAD) {
+            /* the sync was noise: look for one in the rest of the header */
+            uint8_t rest[FRAME_HEADER - 1];
+            memcpy(rest, p->hdr + 1, sizeof(rest));
+            p->stats.header_errors++;
+            p->stats.skipped++;
+            p->state = HUNT_SYNC0;
+            for (size_t i = 0; i < sizeof(rest); i++) frame_parser_feed(p, rest[i]);
+            return FRAME_MORE;
+        }
+        p->crc = frame_crc16(0xFFFF, p->hdr + 2, 3);
+        p->pos = 0;
+        p->state = p->len ? PAYLOAD : TRAILER;
+        return FRAME_MORE;
+
+    case PAYLOAD:
+        p->payload[p->pos++] = byte;
+        if (p->pos == p->len) { p->pos = 0; p->state = TRAILER; }
+        return FRAME_MORE;
+
+    case TRAILER:
+        p->hdr[p->pos++] = byte;        /* header is consumed, reuse it */
+        if (p->pos < FRAME_TRAILER) return FRAME_MORE;
+        p->state = HUNT_SYNC0;
+        {
+            uint16_t crc = frame_crc16(p->crc, p->payload, p->len);
+            uint16_t got = (uint16_t)((p->hdr[0] << 8) | p->hdr[1]);
+            if (crc != got) {
+                p->stats.crc_errors++;
+                return FRAME_MORE;
+            }
+        }
+        frame_done(p);
+        return FRAME_READY;
+    }
+    p->state = HUNT_SYNC0;
+    return FRAME_MORE;
+}
@@ -0,0 +1,68 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Framed link protocol.
+ *
+ *   0  0xA5 0x5A   sync marker
+ *   2  seq         sender's frame counter, wraps at 256
+ *   3  len         payload bytes, 16-bit big-endian
+ *   5  hcrc        CRC-8 (poly 0x07) over seq and len
+ *   6  payload
+ *   .  crc         CRC-16/CCITT-FALSE over seq..payload, big-endian
+ *
+ * The header CRC means a corrupt length is rejected as soon as the header
+ * is complete, so the parser never waits for a payload that does not
+ * exist. Parsing costs O(1) per byte: after a bad header only its five
+ * bytes behind the first sync byte are scanned again, after a bad payload
+ * the parser hunts on from the current byte.
+ */
+
+#define FRAME_SYNC0        0xA5
+#define FRAME_SYNC1        0x5A
+#define FRAME_HEADER       6
+#define FRAME_TRAILER      2
+#define FRAME_OVERHEAD     (FRAME_HEADER + FRAME_TRAILER)
+#define FRAME_MAX_PAYLOAD  1024
+
+/* frame_parser_feed results */
+#define FRAME_MORE   0      /* keep feeding       */
+#define FRAME_READY  1      /* a frame is complete */
+
+typedef struct frame_stats {
+    uint32_t frames;         /* good frames                        */
+    uint32_t header_errors;  /* header CRC or length rejected      */
+    uint32_t crc_errors;     /* payload CRC mismatch               */
+    uint32_t dropped;        /* frames missing from the seq stream */
+    uint64_t skipped;        /* bytes discarded while hunting sync */
+} frame_stats;
+
+/* Parser state, do not modify directly */
+typedef struct frame_parser {
+    uint8_t     state;
+    uint8_t     hdr[FRAME_HEADER];
+    uint16_t    pos;
+    uint16_t    len;                 /* payload length of the frame */
+    uint8_t     seq;
+    uint8_t     have_seq;            /* seq of a previous frame known */
+    uint16_t    crc;
+    uint8_t     payload[FRAME_MAX_PAYLOAD];
+    frame_stats stats;
+} frame_parser;
+
+uint8_t  frame_crc8(const uint8_t *data, size_t len);
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+/* Write one frame to out; returns its size, 0 if cap is too small */
+size_t frame_encode(uint8_t *out, size_t cap, uint8_t seq, const void *payload, uint16_t len);
+
+void frame_parser_init(frame_parser *p);
+
+/* Feed one received byte. On FRAME_READY the frame is in p->payload,
+ * p->len and p->seq until the next call. */
+int  frame_parser_feed(frame_parser *p, uint8_t byte);
+
+#endif /* FRAME_H */
@@ -0,0 +1,149 @@
+#include "iic_profile.h"
+#include <libpynq.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    uint32_t reads, writes, errors;
+    uint64_t bytes;
+    uint64_t ns, max_ns;
+} reg_stats;
+
+typedef struct {
+    int         used;
+    iic_index_t iic;
+    uint8_t     addr;
+    uint8_t     mux_mask;
+    reg_stats   regs[256];
+    uint32_t    hist[IIC_PROF_BUCKETS];
+} dev_stats;
+
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static dev_stats       devices[IIC_PROF_MAX_DEVICES];
+static uint8_t         mux_mask[NUM_IICS];
+static uint64_t        dropped;           /* transfers with no free slot */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static dev_stats *find_device(iic_index_t iic, uint8_t addr, uint8_t mask)
+{
+    for (int i = 0; i < IIC_PROF_MAX_DEVICES; i++) {
+        dev_stats *d = &devices[i];
+        if (!d->used) {
+            d->used = 1; d->iic = iic; d->addr = addr; d->mux_mask = mask;
+            return d;
+        }
+        if (d->iic == iic && d->addr == addr && d->mux_mask == mask) return d;
+    }
+    return NULL;
+}
+
+static void record(iic_index_t iic, uint8_t addr, uint8_t reg, const uint8_t *data,
+                   uint16_t len, int is_read, int err, uint64_t ns)
+{
+    pthread_mutex_lock(&prof_lock);
+    /* the mux itself is keyed without a mask */
+    uint8_t mask = (addr == IIC_PROF_MUX_ADDR) ? 0 : mux_mask[iic];
+    dev_stats *d = find_device(iic, addr, mask);
+    if (!d) { dropped++; pthread_mutex_unlock(&prof_lock); return; }
+
+    reg_stats *r = &d->regs[reg];
+    if (is_read) r->reads++; else r->writes++;
+    if (err) r->errors++; else r->bytes += len;
+    r->ns += ns;
+    if (ns > r->max_ns) r->max_ns = ns;
+
+    uint64_t us = ns / 1000;
+    int b = 0;
+    while (us > 1 && b < IIC_PROF_BUCKETS - 1) { us >>= 1; b++; }
+    d->hist[b]++;
+
+    /* TCA9548A: the last byte written is the new channel mask */
+    if (!is_read && !err && addr == IIC_PROF_MUX_ADDR) mux_mask[iic] = len ? data[len - 1] : reg;
+    pthread_mutex_unlock(&prof_lock);
+}
+
+int iic_prof_read(iic_index_t iic, uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    uint64_t t0 = now_ns();
+    int err = iic_read_register(iic, addr, reg, data, len);
+    record(iic, addr, reg, data, len, 1, err, now_ns() - t0);
+    return err;
+}
+
+int iic_prof_write(iic_index_t iic, uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    uint64_t t0 = now_ns();
+    int err = iic_write_register(iic, addr, reg, data, len);
+    record(iic, addr, reg, data, len, 0, err, now_ns() - t0);
+    return err;
+}
+
+void iic_prof_reset(void)
+{
+    pthread_mutex_lock(&prof_lock);
+    memset(devices, 0, sizeof(devices));
+    dropped = 0;
+    pthread_mutex_unlock(&prof_lock);
+}
+
+void iic_prof_get_totals(iic_prof_totals *out)
+{
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&prof_lock);
+    for (int i = 0; i < IIC_PROF_MAX_DEVICES && devices[i].used; i++) {
+        for (int reg = 0; reg < 256; reg++) {
+            reg_stats *r = &devices[i].regs[reg];
+            out->transfers += r->reads + r->writes;
+            out->bytes     += r->bytes;
+            out->errors    += r->errors;
+            out->ns        += r->ns;
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+}
+
+void iic_prof_dump(FILE *f)
+{
+    pthread_mutex_lock(&prof_lock);
+    for (int i = 0; i < IIC_PROF_MAX_DEVICES && devices[i].used; i++) {
+        dev_stats *d = &devices[i];
+        uint64_t xfers = 0, total_ns = 0;
+        for (int reg = 0; reg < 256; reg++) {
+            xfers    += d->regs[reg].reads + d->regs[reg].writes;
+            total_ns += d->regs[reg].ns;
+        }
+        fprintf(f, "iic%d 0x%02X mux 0x%02X: %llu transfers, %.3f ms\n",
+                (int)d->iic, d->addr, d->mux_mask,
+                (unsigned long long)xfers, total_ns / 1e6);
+        fprintf(f, "  reg    rd    wr   err    bytes   total ms  max us\n");
+        for (int reg = 0; reg < 256; reg++) {
+            reg_stats *r = &d->regs[reg];
+            if (!r->reads && !r->writes) continue;
+            fprintf(f, "  0x%02X %5u %5u %5u %8llu %10.3f %7llu\n", reg,
+                    r->reads, r->writes, r->errors, (unsigned long long)r->bytes,
+                    r->ns / 1e6, (unsigned long long)(r->max_ns / 1000));
+        }
+
+        uint32_t peak = 0;
+        for (int b = 0; b < IIC_PROF_BUCKETS; b++)
+            if (d->hist[b] > peak) peak = d->hist[b];
+        for (int b = 0; b < IIC_PROF_BUCKETS; b++) {
+            if (!d->hist[b]) continue;
+            int bar = (int)((d->hist[b] * 40ULL + peak - 1) / peak);
+            fprintf(f, "  %6u us %6u |%.*s\n", b ? 1u << b : 0u, d->hist[b], bar,
+                    "########################################");
+        }
+    }
+    if (dropped) fprintf(f, "iic profile: %llu transfers not recorded (device table full)\n",
+                         (unsigned long long)dropped);
+    pthread_mutex_unlock(&prof_lock);
+}
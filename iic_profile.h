@@ -0,0 +1,49 @@
+#ifndef IIC_PROFILE_H
+#define IIC_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libpynq.h>
+
+/*
+ * Optional I2C transaction profiler.
+ *
+ * The drivers issue every bus transfer through IIC_READ / IIC_WRITE.  When
+ * built with -DIIC_PROFILE those go through iic_prof_read/iic_prof_write,
+ * which count transfers and bytes and time each call per device and per
+ * register; otherwise they are plain libpynq calls with no overhead.
+ *
+ * Devices are keyed by bus, 7-bit address and the TCA9548A channel mask
+ * that was active, so sensors sharing an address behind the mux are kept
+ * apart.  Registers are the pointer byte as sent on the wire, so TCS3472
+ * entries include the command bits (0x80 / 0xA0).
+ */
+
+#ifdef IIC_PROFILE
+#define IIC_READ(iic, addr, reg, data, len)  iic_prof_read((iic), (addr), (reg), (data), (len))
+#define IIC_WRITE(iic, addr, reg, data, len) iic_prof_write((iic), (addr), (reg), (data), (len))
+#else
+#define IIC_READ(iic, addr, reg, data, len)  iic_read_register((iic), (addr), (reg), (data), (len))
+#define IIC_WRITE(iic, addr, reg, data, len) iic_write_register((iic), (addr), (reg), (data), (len))
+#endif
+
+#define IIC_PROF_MUX_ADDR    0x70  /* writes here update the channel mask */
+#define IIC_PROF_MAX_DEVICES 16
+#define IIC_PROF_BUCKETS     16    /* latency histogram, bucket n = [2^n, 2^(n+1)) us */
+
+/* Totals over everything recorded since the last reset */
+typedef struct iic_prof_totals {
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t ns;
+} iic_prof_totals;
+
+int  iic_prof_read (iic_index_t iic, uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len);
+int  iic_prof_write(iic_index_t iic, uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len);
+void iic_prof_reset(void);
+void iic_prof_get_totals(iic_prof_totals *out);
+/* per-device register table and latency histogram */
+void iic_prof_dump(FILE *f);
+
+#endif /* IIC_PROFILE_H */
@@ -0,0 +1,317 @@
+#include "json_cmd.h"
+
+#include <stddef.h>
+#include <string.h>
+
+typedef enum { FIELD_INT32, FIELD_ENUM } field_type;
+
+/* FIELD_ENUM values, the index is stored */
+static const char *const cmd_types[] = {"move", "flush", "abort", NULL};
+
+/* a known field: its path from the root, dot separated */
+typedef struct {
+    const char *path;
+    field_type  type;
+    size_t      offset;
+    uint32_t    bit;
+    int32_t     min, max;
+    const char *const *names;           /* FIELD_ENUM */
+} field_def;
+
+static const field_def fields[] = {
+    {"id",         FIELD_INT32, offsetof(json_command, id),    JSON_CMD_ID,    0,      65535, NULL},
+    {"cmd",        FIELD_ENUM,  offsetof(json_command, type),  JSON_CMD_TYPE,  0,      0,     cmd_types},
+    {"speed",      FIELD_INT32, offsetof(json_command, speed), JSON_CMD_SPEED, 0,      65535, NULL},
+    {"left",       FIELD_INT32, offsetof(json_command, left),  JSON_CMD_LEFT,  -32768, 32767, NULL},
+    {"right",      FIELD_INT32, offsetof(json_command, right), JSON_CMD_RIGHT, -32768, 32767, NULL},
+    {"move.speed", FIELD_INT32, offsetof(json_command, speed), JSON_CMD_SPEED, 0,      65535, NULL},
+    {"move.left",  FIELD_INT32, offsetof(json_command, left),  JSON_CMD_LEFT,  -32768, 32767, NULL},
+    {"move.right", FIELD_INT32, offsetof(json_command, right), JSON_CMD_RIGHT, -32768, 32767, NULL},
+};
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+typedef struct {
+    const char   *s;
+    size_t        len, pos;
+    int           depth;
+    const char   *key[JSON_MAX_DEPTH];   /* key of each open object level */
+    size_t        key_len[JSON_MAX_DEPTH];
+    json_command *cmd;
+    json_error    err;
+} parser;
+
+static int fail(parser *p, json_status code, const char *what)
+{
+    if (p->err.code == JSON_OK) {
+        p->err.code   = code;
+        p->err.offset = (uint32_t)p->pos;
+        p->err.what   = what;
+    }
+    return 1;
+}
+
+static void skip_ws(parser *p)
+{
+    while (p->pos < p->len) {
+        char c = p->s[p->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        p->pos++;
+    }
+}
+
+static int peek(parser *p)
+{
+    skip_ws(p);
+    return p->pos < p->len ? (unsigned char)p->s[p->pos] : -1;
+}
+
+static int expect(parser *p, char c, const char *what)
+{
+    if (peek(p) != c) return fail(p, JSON_ERR_SYNTAX, what);
+    p->pos++;
+    return 0;
+}
+
+/* field whose path equals the open keys plus `depth` levels, or NULL */
+static const field_def *match_field(parser *p)
+{
+    for (size_t i = 0; i < NUM_FIELDS; i++) {
+        const char *path = fields[i].path;
+        int d;
+        for (d = 0; d < p->depth; d++) {
+            size_t n = p->key_len[d];
+            if (strncmp(path, p->key[d], n) != 0) break;
+            path += n;
+            if (d < p->depth - 1) {
+                if (*path != '.') break;
+                path++;
+            }
+        }
+        if (d == p->depth && *path == '\0') return &fields[i];
+    }
+    return NULL;
+}
+
+/* JSON string; start and n (may be NULL) receive its raw bytes */
+static int parse_string(parser *p, const char **start, size_t *n)
+{
+    if (expect(p, '"', "expected string")) return 1;
+    size_t begin = p->pos;
+    while (p->pos < p->len) {
+        char c = p->s[p->pos];
+        if (c == '"') {
+            if (start) *start = p->s + begin;
+            if (n) *n = p->pos - begin;
+            p->pos++;
+            return 0;
+        }
+        if ((unsigned char)c < 0x20) return fail(p, JSON_ERR_SYNTAX, "control character in string");
+        if (c == '\\') {
+            p->pos++;
+            if (p->pos >= p->len) break;
+            c = p->s[p->pos];
+            if (c == 'u') {
+                for (int i = 0; i < 4; i++) {
+                    p->pos++;
+                    if (p->pos >= p->len || !strchr("0123456789abcdefABCDEF", p->s[p->pos]) || !p->s[p->pos])
+                        return fail(p, JSON_ERR_SYNTAX, "bad \\u escape");
+                }
+            } else if (!strchr("\"\\/bfnrt", c) || !c) {
+                return fail(p, JSON_ERR_SYNTAX, "bad escape");
+            }
+        }
+        p->pos++;
+    }
+    return fail(p, JSON_ERR_SYNTAX, "unterminated string");
+}
+
+/* JSON number; *is_int says whether it was a plain integer, *v holds it
+ * saturated to +-2^62 */
+static int parse_number(parser *p, int64_t *v, int *is_int)
+{
+    int neg = 0;
+    int64_t acc = 0;
+    *is_int = 1;
+
+    if (p->s[p->pos] == '-') { neg = 1; p->pos++; }
+    if (p->pos >= p->len || p->s[p->pos] < '0' || p->s[p->pos] > '9')
+        return fail(p, JSON_ERR_SYNTAX, "expected digit");
+    if (p->s[p->pos] == '0' && p->pos + 1 < p->len && p->s[p->pos + 1] >= '0' && p->s[p->pos + 1] <= '9')
+        return fail(p, JSON_ERR_SYNTAX, "leading zero");
+    while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') {
+        if (acc < (1LL << 62) / 10) acc = acc * 10 + (p->s[p->pos] - '0');
+        else acc = 1LL << 62;
+        p->pos++;
+    }
+    if (p->pos < p->len && p->s[p->pos] == '.') {
+        *is_int = 0;
+        p->pos++;
+        if (p->pos >= p->len || p->s[p->pos] < '0' || p->s[p->pos] > '9')
+            return fail(p, JSON_ERR_SYNTAX, "expected digit after '.'");
+        while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') p->pos++;
+    }
+    if (p->pos < p->len && (p->s[p->pos] == 'e' || p->s[p->pos] == 'E')) {
+        *is_int = 0;
+        p->pos++;
+        if (p->pos < p->len && (p->s[p->pos] == '+' || p->s[p->pos] == '-')) p->pos++;
+        if (p->pos >= p->len || p->s[p->pos] < '0' || p->s[p->pos] > '9')
+            return fail(p, JSON_ERR_SYNTAX, "expected exponent digit");
+        while (p->pos < p->len && p->s[p->pos] >= '0' && p->s[p->pos] <= '9') p->pos++;
+    }
+    *v = neg ? -acc : acc;
+    return 0;
+}
+
+static int parse_literal(parser *p, const char *word)
+{
+    size_t n = strlen(word);
+    if (p->len - p->pos < n || memcmp(p->s + p->pos, word, n) != 0)
+        return fail(p, JSON_ERR_SYNTAX, "unexpected character");
+    p->pos += n;
+    return 0;
+}
+
+static int parse_value(parser *p);
+
+static int parse_object(parser *p)
+{
+    p->pos++;                                   /* '{' */
+    if (p->depth >= JSON_MAX_DEPTH) return fail(p, JSON_ERR_DEPTH, "nested too deep");
+    if (peek(p) == '}') { p->pos++; return 0; }
+
+    while (1) {
+        const char *key;
+        size_t key_len;
+        if (peek(p) != '"') return fail(p, JSON_ERR_SYNTAX, "expected key");
+        if (parse_string(p, &key, &key_len)) return 1;
+        if (expect(p, ':', "expected ':'")) return 1;
+
+        p->key[p->depth]     = key;
+        p->key_len[p->depth] = key_len;
+        p->depth++;
+        int err = parse_value(p);
+        p->depth--;
+        if (err) return 1;
+
+        int c = peek(p);
+        if (c == ',') { p->pos++; continue; }
+        if (c == '}') { p->pos++; return 0; }
+        return fail(p, JSON_ERR_SYNTAX, "expected ',' or '}'");
+    }
+}
+
+static int parse_array(parser *p)
+{
+    p->pos++;                                   /* '[' */
+    if (peek(p) == ']') { p->pos++; return 0; }
+
+    /* array elements are never known fields: hide them behind a level
+     * whose key matches nothing */
+    if (p->depth >= JSON_MAX_DEPTH) return fail(p, JSON_ERR_DEPTH, "nested too deep");
+    p->key[p->depth]     = "[";
+    p->key_len[p->depth] = 1;
+    p->depth++;
+    while (1) {
+        if (parse_value(p)) { p->depth--; return 1; }
+        int c = peek(p);
+        if (c == ',') { p->pos++; continue; }
+        p->depth--;
+        if (c == ']') { p->pos++; return 0; }
+        return fail(p, JSON_ERR_SYNTAX, "expected ',' or ']'");
+    }
+}
+
+static int store_field(parser *p, const field_def *f, int64_t v, int is_int, size_t at)
+{
+    json_command *cmd = p->cmd;
+    size_t here = p->pos;
+    p->pos = at;                                /* report the value's start */
+    if (f->type != FIELD_INT32)  return fail(p, JSON_ERR_TYPE, "expected string");
+    if (!is_int)                 return fail(p, JSON_ERR_TYPE, "expected integer");
+    if (v < f->min || v > f->max) return fail(p, JSON_ERR_RANGE, "integer out of range");
+    if (cmd->present & f->bit)   return fail(p, JSON_ERR_DUPLICATE, "field given twice");
+    p->pos = here;
+
+    *(int32_t *)((char *)cmd + f->offset) = (int32_t)v;
+    cmd->present |= f->bit;
+    return 0;
+}
+
+static int store_enum(parser *p, const field_def *f, size_t at)
+{
+    const char *s;
+    size_t n;
+    if (parse_string(p, &s, &n)) return 1;
+    size_t here = p->pos;
+    p->pos = at;
+    if (p->cmd->present & f->bit) return fail(p, JSON_ERR_DUPLICATE, "field given twice");
+    for (int i = 0; f->names[i]; i++) {
+        if (strlen(f->names[i]) == n && !memcmp(f->names[i], s, n)) {
+            *(int32_t *)((char *)p->cmd + f->offset) = i;
+            p->cmd->present |= f->bit;
+            p->pos = here;
+            return 0;
+        }
+    }
+    return fail(p, JSON_ERR_RANGE, "unknown value");
+}
+
+static int parse_value(parser *p)
+{
+    int c = peek(p);
+    size_t at = p->pos;
+    const field_def *f = (c == '{' || c == '[') ? NULL : match_field(p);
+
+    switch (c) {
+    case '{': return parse_object(p);
+    case '[': return parse_array(p);
+    case '"':
+        if (f && f->type == FIELD_ENUM) return store_enum(p, f, at);
+        if (f) return fail(p, JSON_ERR_TYPE, "expected integer");
+        return parse_string(p, NULL, NULL);
+    case 't': if (f) return fail(p, JSON_ERR_TYPE, "expected integer"); return parse_literal(p, "true");
+    case 'f': if (f) return fail(p, JSON_ERR_TYPE, "expected integer"); return parse_literal(p, "false");
+    case 'n': if (f) return fail(p, JSON_ERR_TYPE, "expected integer"); return parse_literal(p, "null");
+    case -1:  return fail(p, JSON_ERR_SYNTAX, "unexpected end");
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        int64_t v;
+        int is_int;
+        if (parse_number(p, &v, &is_int)) return 1;
+        return f ? store_field(p, f, v, is_int, at) : 0;
+    }
+    return fail(p, JSON_ERR_SYNTAX, "unexpected character");
+}
+
+json_status json_parse_command(const char *json, size_t len, uint32_t required,
+                               json_command *cmd, json_error *err)
+{
+    parser p = {.s = json, .len = len, .cmd = cmd};
+    memset(cmd, 0, sizeof(*cmd));
+
+    if (peek(&p) != '{') fail(&p, JSON_ERR_SYNTAX, "expected '{'");
+    else if (!parse_object(&p) && peek(&p) != -1) fail(&p, JSON_ERR_SYNTAX, "data after object");
+
+    if (p.err.code == JSON_OK && cmd->type == JSON_MOVE && (cmd->present & required) != required) {
+        uint32_t missing = required & ~cmd->present;
+        fail(&p, JSON_ERR_MISSING, (missing & JSON_CMD_LEFT)  ? "missing \"left\""  :
+                                   (missing & JSON_CMD_RIGHT) ? "missing \"right\"" :
+                                                                "missing \"speed\"");
+    }
+    if (err) *err = p.err;
+    return p.err.code;
+}
+
+const char *json_strerror(json_status code)
+{
+    switch (code) {
+    case JSON_OK:            return "ok";
+    case JSON_ERR_SYNTAX:    return "syntax error";
+    case JSON_ERR_TYPE:      return "wrong type";
+    case JSON_ERR_RANGE:     return "out of range";
+    case JSON_ERR_DEPTH:     return "too deep";
+    case JSON_ERR_DUPLICATE: return "duplicate field";
+    case JSON_ERR_MISSING:   return "missing field";
+    }
+    return "unknown error";
+}
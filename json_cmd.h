@@ -0,0 +1,65 @@
+#ifndef JSON_CMD_H
+#define JSON_CMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * JSON command parser.
+ *
+ * One pass over the payload, no allocation: keys are matched by their full
+ * path from the root (so "left" never matches "cleft" or a string value),
+ * known fields are stored in a json_command and everything else is
+ * validated and skipped. Move fields may be given at the top level or
+ * nested under "move":
+ *
+ *   {"speed":3072,"left":-200,"right":200}
+ *   {"id":12,"move":{"speed":3072,"left":-200,"right":200}}
+ *   {"id":13,"cmd":"flush"}        also "abort"; "move" is the default
+ */
+
+#define JSON_MAX_DEPTH   8
+
+typedef enum {
+    JSON_OK = 0,
+    JSON_ERR_SYNTAX,     /* not well-formed JSON            */
+    JSON_ERR_TYPE,       /* known field has the wrong type  */
+    JSON_ERR_RANGE,      /* number does not fit the field   */
+    JSON_ERR_DEPTH,      /* nested deeper than JSON_MAX_DEPTH */
+    JSON_ERR_DUPLICATE,  /* known field given twice         */
+    JSON_ERR_MISSING     /* required field absent           */
+} json_status;
+
+typedef struct json_error {
+    json_status code;
+    uint32_t    offset;  /* byte where the problem was found */
+    const char *what;    /* short description                */
+} json_error;
+
+/* json_command.present bits */
+#define JSON_CMD_SPEED   0x01
+#define JSON_CMD_LEFT    0x02
+#define JSON_CMD_RIGHT   0x04
+#define JSON_CMD_ID      0x08
+#define JSON_CMD_TYPE    0x10
+
+/* json_command.type */
+typedef enum { JSON_MOVE = 0, JSON_FLUSH, JSON_ABORT } json_cmd_type;
+
+typedef struct json_command {
+    uint32_t present;
+    int32_t  type;       /* json_cmd_type                    */
+    int32_t  id;         /* host's command id, 0-65535       */
+    int32_t  speed;      /* stepper period, lower is faster  */
+    int32_t  left, right;
+} json_command;
+
+/* Parse a payload of len bytes (need not be terminated). `required` are
+ * JSON_CMD_* bits a move command must have. Returns JSON_OK or the error
+ * code also stored in *err (err may be NULL). */
+json_status json_parse_command(const char *json, size_t len, uint32_t required,
+                               json_command *cmd, json_error *err);
+
+const char *json_strerror(json_status code);
+
+#endif /* JSON_CMD_H */
@@ -0,0 +1,240 @@
+#include "motion.h"
+#include <libpynq.h>
+
+#include <string.h>
+#include <time.h>
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* absolute CLOCK_MONOTONIC timeout `us` from now, for pthread_cond_timedwait
+ * on m->cond (created with that clock in motion_init) */
+static struct timespec timeout_in_us(uint64_t us)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec  += (time_t)(us / 1000000ULL);
+    ts.tv_nsec += (long)(us % 1000000ULL) * 1000L;
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return ts;
+}
+
+static uint32_t steps_abs(int16_t n) { return (uint32_t)(n < 0 ? -n : n); }
+
+/* set the wheel periods for `done` steps into the move; returns the
+ * leading wheel's period so unchanged speeds are not rewritten */
+static uint16_t apply_profile(const motion_profile *p, uint16_t cruise, int16_t left,
+                              int16_t right, uint32_t done, uint16_t last)
+{
+    uint32_t total = steps_abs(left) > steps_abs(right) ? steps_abs(left) : steps_abs(right);
+    uint16_t period = profile_period(p, cruise, done, total);
+    if (period != last) {
+        uint16_t pl, pr;
+        profile_wheel_periods(period, left, right, &pl, &pr);
+        stepper_set_speed(pl, pr);
+    }
+    return period;
+}
+
+/* run one move, called with m->lock held */
+static void run_move(motion *m)
+{
+    int16_t left = m->result.left, right = m->result.right;
+    int16_t rem_l = left, rem_r = right;
+    int16_t told_l = 0, told_r = 0;         /* steps passed to progress */
+    uint32_t lead = steps_abs(left) > steps_abs(right) ? steps_abs(left) : steps_abs(right);
+    motion_profile profile = m->profile;
+    motion_progress_fn progress = m->progress;
+    void *ctx = m->progress_ctx;
+    uint16_t cruise = m->speed;
+    int reason = 0;
+
+    pthread_mutex_unlock(&m->lock);
+    stepper_enable();
+    uint16_t period = apply_profile(&profile, cruise, left, right, 0, 0);
+    stepper_steps(left, right);
+    pthread_mutex_lock(&m->lock);
+
+    while (1) {
+        reason = m->abort_reason;
+        if (reason) break;
+        pthread_mutex_unlock(&m->lock);
+        int done = stepper_steps_done();
+        if (!done && (profile.kind != PROFILE_CONSTANT || progress)) {
+            stepper_get_steps(&rem_l, &rem_r);
+            /* follow the ramp from the leading wheel's position */
+            uint32_t rem = steps_abs(rem_l) > steps_abs(rem_r) ? steps_abs(rem_l) : steps_abs(rem_r);
+            period = apply_profile(&profile, cruise, left, right, lead - rem, period);
+            if (progress && (left - rem_l != told_l || right - rem_r != told_r)) {
+                progress(left - rem_l - told_l, right - rem_r - told_r, ctx);
+                told_l = left - rem_l;
+                told_r = right - rem_r;
+            }
+        }
+        pthread_mutex_lock(&m->lock);
+        if (done) break;
+
+        /* motion_abort signals the condition, so this wakes early */
+        struct timespec ts = timeout_in_us(MOTION_POLL_US);
+        pthread_cond_timedwait(&m->cond, &m->lock, &ts);
+    }
+
+    pthread_mutex_unlock(&m->lock);
+    if (reason) {
+        stepper_get_steps(&rem_l, &rem_r);
+        stepper_reset();
+    } else {
+        rem_l = rem_r = 0;
+    }
+    stepper_disable();
+    if (progress && (left - rem_l != told_l || right - rem_r != told_r))
+        progress(left - rem_l - told_l, right - rem_r - told_r, ctx);
+    pthread_mutex_lock(&m->lock);
+
+    m->result.state      = reason ? MOTION_ABORTED : MOTION_DONE;
+    m->result.reason     = reason;
+    m->result.left_done  = left - rem_l;
+    m->result.right_done = right - rem_r;
+    m->result.t_us       = time_us();
+    m->abort_reason      = 0;
+    pthread_cond_broadcast(&m->cond);
+}
+
+static void *motion_thread(void *arg)
+{
+    motion *m = arg;
+    pthread_mutex_lock(&m->lock);
+    while (m->alive) {
+        if (!m->pending) {
+            pthread_cond_wait(&m->cond, &m->lock);
+            continue;
+        }
+        m->pending = 0;
+        run_move(m);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+int motion_init(motion *m)
+{
+    if (!m) return 1;
+    memset(m, 0, sizeof(*m));
+    m->result.state = MOTION_IDLE;
+    if (pthread_mutex_init(&m->lock, NULL)) return 1;
+
+    /* timed waits on CLOCK_MONOTONIC, immune to wall-clock steps */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_cond_init(&m->cond, &attr) != 0;
+    pthread_condattr_destroy(&attr);
+    if (err) return 1;
+
+    m->alive = 1;
+    if (pthread_create(&m->thread, NULL, motion_thread, m)) {
+        m->alive = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void motion_destroy(motion *m)
+{
+    if (!m || !m->alive) return;
+    motion_abort(m, -1);
+    pthread_mutex_lock(&m->lock);
+    m->alive = 0;
+    pthread_cond_broadcast(&m->cond);
+    pthread_mutex_unlock(&m->lock);
+    pthread_join(m->thread, NULL);
+    pthread_cond_destroy(&m->cond);
+    pthread_mutex_destroy(&m->lock);
+}
+
+int motion_start(motion *m, uint16_t speed, int16_t left, int16_t right)
+{
+    pthread_mutex_lock(&m->lock);
+    if (m->pending || m->result.state == MOTION_RUNNING) {
+        pthread_mutex_unlock(&m->lock);
+        return 1;
+    }
+    m->speed             = speed;
+    m->abort_reason      = 0;
+    m->result            = (motion_result){0};
+    m->result.state      = MOTION_RUNNING;
+    m->result.left       = left;
+    m->result.right      = right;
+    m->pending           = 1;
+    pthread_cond_broadcast(&m->cond);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+void motion_set_profile(motion *m, const motion_profile *p)
+{
+    pthread_mutex_lock(&m->lock);
+    if (p) m->profile = *p;
+    else   m->profile = (motion_profile){PROFILE_CONSTANT, 0, 0};
+    pthread_mutex_unlock(&m->lock);
+}
+
+void motion_set_progress(motion *m, motion_progress_fn fn, void *ctx)
+{
+    pthread_mutex_lock(&m->lock);
+    m->progress     = fn;
+    m->progress_ctx = ctx;
+    pthread_mutex_unlock(&m->lock);
+}
+
+int motion_abort(motion *m, int reason)
+{
+    pthread_mutex_lock(&m->lock);
+    int running = m->result.state == MOTION_RUNNING;
+    if (running && !m->abort_reason) {
+        m->abort_reason = reason ? reason : -1;
+        pthread_cond_broadcast(&m->cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return !running;
+}
+
+int motion_busy(motion *m)
+{
+    pthread_mutex_lock(&m->lock);
+    int busy = m->result.state == MOTION_RUNNING;
+    pthread_mutex_unlock(&m->lock);
+    return busy;
+}
+
+int motion_current(motion *m, motion_result *out)
+{
+    pthread_mutex_lock(&m->lock);
+    *out = m->result;
+    pthread_mutex_unlock(&m->lock);
+    return out->state == MOTION_RUNNING;
+}
+
+int motion_wait(motion *m, uint64_t deadline_us, motion_result *out)
+{
+    int err = 0;
+    pthread_mutex_lock(&m->lock);
+    while (m->result.state == MOTION_RUNNING && err == 0) {
+        if (deadline_us) {
+            uint64_t now = time_us();
+            if (now >= deadline_us) { err = 1; break; }
+            struct timespec ts = timeout_in_us(deadline_us - now);
+            err = pthread_cond_timedwait(&m->cond, &m->lock, &ts);
+        } else {
+            pthread_cond_wait(&m->cond, &m->lock);
+        }
+    }
+    int running = m->result.state == MOTION_RUNNING;
+    if (out) *out = m->result;
+    pthread_mutex_unlock(&m->lock);
+    return running;
+}
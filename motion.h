@@ -0,0 +1,91 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <libpynq.h>
+#include "motion_profile.h"
+
+/*
+ * Motion executor.
+ *
+ * Runs stepper moves on a thread of its own so the caller (and the sensor
+ * scheduler) keep running while the wheels turn. A move can be aborted from
+ * any thread, e.g. a sensor callback that sees an obstacle; the steppers
+ * are stopped within MOTION_POLL_US.
+ *
+ * Moves follow the velocity profile set with motion_set_profile (constant
+ * speed by default); the wheel periods are updated from the steps taken
+ * every MOTION_POLL_US, and on arcs both wheels finish together.
+ *
+ * Steps taken are reported as they happen to the callback set with
+ * motion_set_progress (e.g. odometry), including those of a move that
+ * is cut short.
+ */
+
+#define MOTION_POLL_US 1000   /* how often a running move is checked */
+
+typedef enum {
+    MOTION_IDLE,       /* no move since motion_init           */
+    MOTION_RUNNING,
+    MOTION_DONE,       /* all commanded steps were taken      */
+    MOTION_ABORTED     /* stopped early by motion_abort       */
+} motion_state;
+
+/* Outcome of the last move */
+typedef struct motion_result {
+    motion_state state;
+    int          reason;            /* motion_abort reason, 0 when done */
+    int16_t      left, right;       /* steps commanded                  */
+    int16_t      left_done, right_done;
+    uint64_t     t_us;              /* CLOCK_MONOTONIC time it ended    */
+} motion_result;
+
+/* Steps taken since the last call, from the motion thread */
+typedef void (*motion_progress_fn)(int16_t left, int16_t right, void *ctx);
+
+/* Handle for the executor, do not modify directly */
+typedef struct motion {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             alive;
+    int             pending;        /* a move waits to be started  */
+    int             abort_reason;   /* non-zero: stop current move */
+    uint16_t        speed;          /* cruise period               */
+    motion_profile  profile;
+    motion_progress_fn progress;
+    void           *progress_ctx;
+    motion_result   result;
+} motion;
+
+/* Start the executor thread. stepper_init must have been called. */
+int  motion_init(motion *m);
+void motion_destroy(motion *m);
+
+/* Queue a move; returns 1 when a move is already running. */
+int  motion_start(motion *m, uint16_t speed, int16_t left, int16_t right);
+
+/* Velocity profile for moves started from now on; NULL for constant
+ * speed. speed passed to motion_start is then the cruise period. */
+void motion_set_profile(motion *m, const motion_profile *p);
+
+/* Report steps as they are taken; fn NULL to stop. Takes effect from the
+ * next move. */
+void motion_set_progress(motion *m, motion_progress_fn fn, void *ctx);
+
+/* Stop the running move; reason must be non-zero. Safe from any thread.
+ * Returns 1 when no move was running. */
+int  motion_abort(motion *m, int reason);
+
+/* 1 while a move is queued or running */
+int  motion_busy(motion *m);
+
+/* The move being run, or the last one; returns 1 if it is still running */
+int  motion_current(motion *m, motion_result *out);
+
+/* Wait for the move to end or deadline_us (0 = forever).
+ * Returns 0 when it ended, 1 on timeout; `out` may be NULL. */
+int  motion_wait(motion *m, uint64_t deadline_us, motion_result *out);
+
+#endif /* MOTION_H */
@@ -0,0 +1,44 @@
+#include "motion_profile.h"
+
+#include <math.h>
+
+/* speed reached `s` steps into a ramp of `n` steps, as a fraction 0..1 of
+ * the way from start to cruise speed */
+static float ramp(profile_kind kind, uint32_t s, uint32_t n)
+{
+    if (s >= n) return 1.0f;
+    float u = (float)s / (float)n;
+    if (kind == PROFILE_SCURVE) return u * u * (3.0f - 2.0f * u);
+    /* constant acceleration: v^2 grows linearly with distance, this is
+     * the fraction of the v^2 span */
+    return u;
+}
+
+uint16_t profile_period(const motion_profile *p, uint16_t cruise, uint32_t done, uint32_t total)
+{
+    if (!p || p->kind == PROFILE_CONSTANT || !p->accel_steps || cruise >= p->start_period)
+        return cruise;
+
+    uint32_t left = done < total ? total - done : 0;
+    uint32_t s    = done < left ? done : left;     /* nearest standstill */
+    float f  = ramp(p->kind, s, p->accel_steps);
+    float v0 = 1.0f / p->start_period, vc = 1.0f / cruise;
+    float v;
+    if (p->kind == PROFILE_TRAPEZOID) v = sqrtf(v0 * v0 + (vc * vc - v0 * v0) * f);
+    else                              v = v0 + (vc - v0) * f;
+    return (uint16_t)lroundf(1.0f / v);
+}
+
+void profile_wheel_periods(uint16_t period, int16_t left, int16_t right,
+                           uint16_t *left_period, uint16_t *right_period)
+{
+    uint32_t l = (uint32_t)(left < 0 ? -left : left);
+    uint32_t r = (uint32_t)(right < 0 ? -right : right);
+    uint32_t lp = period, rp = period;
+    if (l && r) {
+        if (l > r) rp = (period * l + r / 2) / r;
+        else       lp = (period * r + l / 2) / l;
+    }
+    *left_period  = (uint16_t)(lp > 0xFFFF ? 0xFFFF : lp);
+    *right_period = (uint16_t)(rp > 0xFFFF ? 0xFFFF : rp);
+}
@@ -0,0 +1,46 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Velocity profiles for stepper moves.
+ *
+ * Speeds are stepper periods in controller ticks (lower is faster), as
+ * taken by stepper_set_speed. A move starts and ends at start_period, the
+ * fastest rate a wheel can take from standstill without missing steps,
+ * and ramps to the commanded cruise period over accel_steps steps:
+ *
+ *   PROFILE_CONSTANT   no ramp, the whole move at the commanded period
+ *   PROFILE_TRAPEZOID  constant acceleration, then cruise, then braking
+ *   PROFILE_SCURVE     as trapezoid, but the acceleration itself eases in
+ *                      and out (smoothstep), so there is no jerk at the
+ *                      ends of the ramps
+ *
+ * The ramp is a function of position, not time: the period is looked up
+ * from the steps taken and the steps left, so a move shorter than two
+ * ramps simply never reaches cruise. The wheel with fewer steps runs
+ * proportionally slower so both finish together on arcs.
+ */
+
+typedef enum {
+    PROFILE_CONSTANT,
+    PROFILE_TRAPEZOID,
+    PROFILE_SCURVE
+} profile_kind;
+
+typedef struct motion_profile {
+    profile_kind kind;
+    uint16_t     start_period;  /* period from and to standstill    */
+    uint16_t     accel_steps;   /* steps from start_period to cruise */
+} motion_profile;
+
+/* Period for the wheel with the most steps after `done` of `total` steps */
+uint16_t profile_period(const motion_profile *p, uint16_t cruise, uint32_t done, uint32_t total);
+
+/* Split a period for the leading wheel into per-wheel periods so both
+ * wheels finish together; a wheel with no steps gets the same period. */
+void profile_wheel_periods(uint16_t period, int16_t left, int16_t right,
+                           uint16_t *left_period, uint16_t *right_period);
+
+#endif /* MOTION_PROFILE_H */
@@ -0,0 +1,152 @@
+#include "msg.h"
+
+#include <string.h>
+
+static const char *colour_names[] = {"unknown", "black", "white", "red", "green", "blue"};
+
+static void put16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+static void put32(uint8_t *p, uint32_t v) { put16(p, (uint16_t)(v >> 16)); put16(p + 2, (uint16_t)v); }
+static uint16_t get16(const uint8_t *p)   { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t get32(const uint8_t *p)   { return ((uint32_t)get16(p) << 16) | get16(p + 2); }
+
+/* size of a known type/version, 0 otherwise; version 2 adds the id */
+static size_t msg_size(uint8_t type, uint8_t version)
+{
+    size_t id = (version == 2) ? 2 : 0;
+    if (version != 1 && version != 2) return 0;
+    switch (type) {
+    case MSG_MOVE:     return MSG_HEADER + id + 6;
+    case MSG_FLUSH:
+    case MSG_ABORT:    return version == 2 ? MSG_HEADER + 2 : 0;
+    case MSG_SNAPSHOT: return MSG_HEADER + id + 8;
+    case MSG_ACK:      return MSG_HEADER + id + 6;
+    case MSG_POSE:     return version == 2 ? MSG_HEADER + 8 : 0;
+    case MSG_MAP:      return version == 2 ? MSG_HEADER + 4 : 0;   /* + len */
+    }
+    return 0;
+}
+
+/* no message type is a JSON whitespace byte, so skipping them is safe */
+int msg_is_json(const uint8_t *payload, size_t len)
+{
+    size_t i = 0;
+    while (i < len && (payload[i] == ' ' || payload[i] == '\t' || payload[i] == '\r' || payload[i] == '\n'))
+        i++;
+    return i < len && payload[i] == '{';
+}
+
+size_t msg_encode(uint8_t *out, size_t cap, const msg *m)
+{
+    uint8_t version = m->version ? m->version : MSG_VERSION;
+    size_t n = msg_size(m->type, version);
+    if (n && m->type == MSG_MAP) n += m->u.map.len;
+    if (!n || cap < n) return 0;
+
+    out[0] = m->type;
+    out[1] = version;
+    uint8_t *b = out + MSG_HEADER;
+    switch (m->type) {
+    case MSG_MOVE:
+        if (version == 2) { put16(b, m->u.move.id); b += 2; }
+        put16(b, m->u.move.speed);
+        put16(b + 2, (uint16_t)m->u.move.left);
+        put16(b + 4, (uint16_t)m->u.move.right);
+        break;
+    case MSG_FLUSH:
+    case MSG_ABORT:
+        put16(b, m->u.control.id);
+        break;
+    case MSG_SNAPSHOT:
+        if (version == 2) { put16(b, m->u.snapshot.id); b += 2; }
+        put32(b, m->u.snapshot.t_ms);
+        put16(b + 4, (uint16_t)m->u.snapshot.distance_mm);
+        b[6] = m->u.snapshot.colour[0];
+        b[7] = m->u.snapshot.colour[1];
+        break;
+    case MSG_ACK:
+        if (version == 2) { put16(b, m->u.ack.id); b += 2; }
+        b[0] = m->u.ack.status;
+        b[1] = m->u.ack.reason;
+        put16(b + 2, (uint16_t)m->u.ack.left_done);
+        put16(b + 4, (uint16_t)m->u.ack.right_done);
+        break;
+    case MSG_POSE:
+        put16(b, m->u.pose.id);
+        put16(b + 2, (uint16_t)m->u.pose.x_mm);
+        put16(b + 4, (uint16_t)m->u.pose.y_mm);
+        put16(b + 6, (uint16_t)m->u.pose.heading_cdeg);
+        break;
+    case MSG_MAP:
+        put16(b, m->u.map.id);
+        put16(b + 2, m->u.map.len);
+        if (m->u.map.len) memcpy(b + 4, m->u.map.delta, m->u.map.len);
+        break;
+    }
+    return n;
+}
+
+size_t msg_decode(const uint8_t *in, size_t len, msg *m)
+{
+    if (len < MSG_HEADER) return 0;
+    size_t n = msg_size(in[0], in[1]);
+    if (!n || len < n) return 0;
+    if (in[0] == MSG_MAP) {
+        n += get16(in + MSG_HEADER + 2);
+        if (len < n) return 0;
+    }
+
+    memset(m, 0, sizeof(*m));
+    m->type    = in[0];
+    m->version = in[1];
+    const uint8_t *b = in + MSG_HEADER;
+    switch (m->type) {
+    case MSG_MOVE:
+        if (m->version == 2) { m->u.move.id = get16(b); b += 2; }
+        m->u.move.speed = get16(b);
+        m->u.move.left  = (int16_t)get16(b + 2);
+        m->u.move.right = (int16_t)get16(b + 4);
+        break;
+    case MSG_FLUSH:
+    case MSG_ABORT:
+        m->u.control.id = get16(b);
+        break;
+    case MSG_SNAPSHOT:
+        if (m->version == 2) { m->u.snapshot.id = get16(b); b += 2; }
+        m->u.snapshot.t_ms        = get32(b);
+        m->u.snapshot.distance_mm = (int16_t)get16(b + 4);
+        m->u.snapshot.colour[0]   = b[6];
+        m->u.snapshot.colour[1]   = b[7];
+        break;
+    case MSG_ACK:
+        if (m->version == 2) { m->u.ack.id = get16(b); b += 2; }
+        m->u.ack.status     = b[0];
+        m->u.ack.reason     = b[1];
+        m->u.ack.left_done  = (int16_t)get16(b + 2);
+        m->u.ack.right_done = (int16_t)get16(b + 4);
+        break;
+    case MSG_POSE:
+        m->u.pose.id           = get16(b);
+        m->u.pose.x_mm         = (int16_t)get16(b + 2);
+        m->u.pose.y_mm         = (int16_t)get16(b + 4);
+        m->u.pose.heading_cdeg = (int16_t)get16(b + 6);
+        break;
+    case MSG_MAP:
+        m->u.map.id    = get16(b);
+        m->u.map.len   = get16(b + 2);
+        m->u.map.delta = b + 4;
+        break;
+    }
+    return n;
+}
+
+msg_colour msg_colour_from_name(const char *name)
+{
+    for (size_t i = 0; i < sizeof(colour_names) / sizeof(colour_names[0]); i++)
+        if (!strcmp(name, colour_names[i])) return (msg_colour)i;
+    return MSG_COLOUR_UNKNOWN;
+}
+
+const char *msg_colour_name(msg_colour c)
+{
+    return (size_t)c < sizeof(colour_names) / sizeof(colour_names[0]) ? colour_names[c] : "unknown";
+}
@@ -0,0 +1,128 @@
+#ifndef MSG_H
+#define MSG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary command and telemetry messages.
+ *
+ * A payload is either JSON (first byte '{') or one or more binary messages
+ * back to back. Each binary message is
+ *
+ *   type  u8     MSG_MOVE, MSG_SNAPSHOT, MSG_ACK, ...
+ *   ver   u8     layout version of that type
+ *   body         fixed layout, multi-byte fields big-endian
+ *
+ * Version 2 starts every body with a 16-bit command id; acks and
+ * snapshots carry the id of the move they belong to. Version 1 layouts
+ * (no id) are still decoded and can still be encoded.
+ *
+ * MSG_MAP is the one variable-length message: its body ends with `len`
+ * bytes of occupancy grid delta (occ_grid.h).
+ *
+ * The robot answers in the encoding and version the command arrived in.
+ * The same encoder and decoder are meant to be built into the host.
+ */
+
+#define MSG_VERSION      2
+
+#define MSG_MOVE         0x01   /* host -> robot */
+#define MSG_FLUSH        0x02   /* host -> robot, v2: drop queued moves        */
+#define MSG_ABORT        0x03   /* host -> robot, v2: flush and stop the move  */
+#define MSG_SNAPSHOT     0x81   /* robot -> host */
+#define MSG_ACK          0x82   /* robot -> host */
+#define MSG_POSE         0x83   /* robot -> host, v2: odometry pose            */
+#define MSG_MAP          0x84   /* robot -> host, v2: occupancy grid delta     */
+
+/* sizes of the current version */
+#define MSG_HEADER       2
+#define MSG_MOVE_LEN     (MSG_HEADER + 8)
+#define MSG_CONTROL_LEN  (MSG_HEADER + 2)
+#define MSG_SNAPSHOT_LEN (MSG_HEADER + 10)
+#define MSG_ACK_LEN      (MSG_HEADER + 8)
+#define MSG_POSE_LEN     (MSG_HEADER + 8)
+#define MSG_MAP_LEN(n)   (MSG_HEADER + 4 + (n))
+
+/* colour classes as sent on the wire */
+typedef enum {
+    MSG_COLOUR_UNKNOWN = 0,
+    MSG_COLOUR_BLACK,
+    MSG_COLOUR_WHITE,
+    MSG_COLOUR_RED,
+    MSG_COLOUR_GREEN,
+    MSG_COLOUR_BLUE
+} msg_colour;
+
+/* msg_ack.status */
+#define MSG_ACK_DONE     0    /* move (or flush/abort) completed   */
+#define MSG_ACK_ABORTED  1    /* move stopped early, see reason    */
+#define MSG_ACK_REJECTED 2    /* move not queued, queue full       */
+#define MSG_ACK_FLUSHED  3    /* move dropped from the queue       */
+
+typedef struct msg_move {
+    uint16_t id;
+    uint16_t speed;
+    int16_t  left, right;
+} msg_move;
+
+/* MSG_FLUSH, MSG_ABORT */
+typedef struct msg_control {
+    uint16_t id;
+} msg_control;
+
+typedef struct msg_snapshot {
+    uint16_t id;              /* move it follows, 0 if none       */
+    uint32_t t_ms;            /* robot clock, wraps after 49 days */
+    int16_t  distance_mm;     /* -1 when no reading               */
+    uint8_t  colour[2];       /* msg_colour of sensor 1 and 2     */
+} msg_snapshot;
+
+typedef struct msg_ack {
+    uint16_t id;
+    uint8_t status;           /* MSG_ACK_*                        */
+    uint8_t reason;           /* abort reason, 0 when done        */
+    int16_t left_done, right_done;
+} msg_ack;
+
+typedef struct msg_pose {
+    uint16_t id;              /* move it follows, 0 if none       */
+    int16_t  x_mm, y_mm;
+    int16_t  heading_cdeg;    /* 0.01 degree, counter-clockwise   */
+} msg_pose;
+
+typedef struct msg_map {
+    uint16_t       id;        /* move it follows, 0 if none       */
+    uint16_t       len;
+    const uint8_t *delta;     /* decode: points into the input    */
+} msg_map;
+
+typedef struct msg {
+    uint8_t type;
+    uint8_t version;
+    union {
+        msg_move     move;
+        msg_control  control;
+        msg_snapshot snapshot;
+        msg_ack      ack;
+        msg_pose     pose;
+        msg_map      map;
+    } u;
+} msg;
+
+/* 1 if a payload is JSON rather than binary messages: its first
+ * non-whitespace byte is '{' */
+int    msg_is_json(const uint8_t *payload, size_t len);
+
+/* Write one message in layout m->version (0 = MSG_VERSION); returns its
+ * size, 0 if it does not fit or the type/version is unknown. */
+size_t msg_encode(uint8_t *out, size_t cap, const msg *m);
+
+/* Read one message; returns the bytes consumed, 0 when the data is short
+ * or the type/version is unknown. */
+size_t msg_decode(const uint8_t *in, size_t len, msg *m);
+
+msg_colour  msg_colour_from_name(const char *name);
+const char *msg_colour_name(msg_colour c);
+
+#endif /* MSG_H */
@@ -0,0 +1,172 @@
+#include "occ_grid.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* world mm to cell index; the origin is in the middle of the grid */
+static int to_cell(float mm)
+{
+    return (int)floorf(mm / OCC_CELL_MM) + OCC_CELLS / 2;
+}
+
+static int on_map(int cx, int cy)
+{
+    return cx >= 0 && cy >= 0 && cx < OCC_CELLS && cy < OCC_CELLS;
+}
+
+static occ_tile *tile_of(occ_grid *g, int cx, int cy, int *i)
+{
+    *i = (cy % OCC_TILE) * OCC_TILE + (cx % OCC_TILE);
+    return &g->tile[(cy / OCC_TILE) * OCC_TILES + (cx / OCC_TILE)];
+}
+
+static int8_t quantum(int8_t lo)
+{
+    return (int8_t)(lo / OCC_LO_QUANTUM);
+}
+
+/* flag a cell for occ_take_changes; called with g->lock held */
+static void set_dirty(occ_grid *g, occ_tile *t, int i)
+{
+    if (!t->dirty) g->dirty_tiles++;
+    t->dirty |= 1ULL << i;
+}
+
+static void update_cell(occ_grid *g, int cx, int cy, int delta)
+{
+    if (!on_map(cx, cy)) return;
+    int i;
+    occ_tile *t = tile_of(g, cx, cy, &i);
+    int lo = t->lo[i] + delta;
+    if (lo >  OCC_LO_MAX) lo =  OCC_LO_MAX;
+    if (lo < -OCC_LO_MAX) lo = -OCC_LO_MAX;
+    t->lo[i] = (int8_t)lo;
+    if (quantum(t->lo[i]) != t->sent[i]) set_dirty(g, t, i);
+}
+
+int occ_init(occ_grid *g)
+{
+    if (!g) return 1;
+    memset(g, 0, sizeof(*g));
+    return pthread_mutex_init(&g->lock, NULL) != 0;
+}
+
+void occ_destroy(occ_grid *g)
+{
+    if (g) pthread_mutex_destroy(&g->lock);
+}
+
+void occ_add_range(occ_grid *g, float x_mm, float y_mm, float heading, int distance_mm)
+{
+    if (distance_mm < 0) return;
+    int hit = distance_mm < OCC_MAX_RANGE_MM;
+    float r = hit ? (float)distance_mm : (float)OCC_MAX_RANGE_MM;
+
+    /* Bresenham from the sensor cell to the end cell */
+    int x0 = to_cell(x_mm), y0 = to_cell(y_mm);
+    int x1 = to_cell(x_mm + r * cosf(heading)), y1 = to_cell(y_mm + r * sinf(heading));
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+
+    pthread_mutex_lock(&g->lock);
+    while (x0 != x1 || y0 != y1) {
+        update_cell(g, x0, y0, OCC_LO_MISS);
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+    update_cell(g, x1, y1, hit ? OCC_LO_HIT : OCC_LO_MISS);
+    pthread_mutex_unlock(&g->lock);
+}
+
+void occ_mark_cell(occ_grid *g, float x_mm, float y_mm, occ_mark mark)
+{
+    int cx = to_cell(x_mm), cy = to_cell(y_mm), i;
+    if (!on_map(cx, cy)) return;
+    pthread_mutex_lock(&g->lock);
+    occ_tile *t = tile_of(g, cx, cy, &i);
+    if (t->mark[i] != mark) {
+        t->mark[i] = (uint8_t)mark;
+        set_dirty(g, t, i);
+    }
+    if (mark == OCC_MARK_CRATER) update_cell(g, cx, cy, OCC_LO_HIT);
+    pthread_mutex_unlock(&g->lock);
+}
+
+int occ_get(occ_grid *g, float x_mm, float y_mm, int8_t *lo, occ_mark *mark)
+{
+    int cx = to_cell(x_mm), cy = to_cell(y_mm), i;
+    if (!on_map(cx, cy)) return 1;
+    pthread_mutex_lock(&g->lock);
+    occ_tile *t = tile_of(g, cx, cy, &i);
+    if (lo)   *lo   = t->lo[i];
+    if (mark) *mark = (occ_mark)t->mark[i];
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+uint32_t occ_take_changes(occ_grid *g, occ_change *out, uint32_t max)
+{
+    uint32_t n = 0;
+    pthread_mutex_lock(&g->lock);
+    for (uint32_t k = 0; k < OCC_TILES * OCC_TILES && g->dirty_tiles && n < max; k++) {
+        uint32_t ti = (g->next_tile + k) % (OCC_TILES * OCC_TILES);
+        occ_tile *t = &g->tile[ti];
+        if (!t->dirty) continue;
+        while (t->dirty && n < max) {
+            int i = __builtin_ctzll(t->dirty);
+            t->dirty &= t->dirty - 1;
+            t->sent[i] = quantum(t->lo[i]);
+            out[n].x    = (uint16_t)((ti % OCC_TILES) * OCC_TILE + i % OCC_TILE);
+            out[n].y    = (uint16_t)((ti / OCC_TILES) * OCC_TILE + i / OCC_TILE);
+            out[n].lo   = t->lo[i];
+            out[n].mark = t->mark[i];
+            n++;
+        }
+        if (!t->dirty) g->dirty_tiles--;
+        g->next_tile = t->dirty ? ti : ti + 1;  /* resume after this */
+    }
+    pthread_mutex_unlock(&g->lock);
+    return n;
+}
+
+size_t occ_encode_delta(const occ_change *c, uint32_t n, uint8_t *out, size_t cap)
+{
+    size_t len = 0;
+    for (uint32_t k = 0; k < n && len + OCC_DELTA_RECORD <= cap; k++) {
+        uint16_t cell = (uint16_t)(c[k].y * OCC_CELLS + c[k].x);
+        out[len++] = (uint8_t)(cell >> 8);
+        out[len++] = (uint8_t)cell;
+        out[len++] = (uint8_t)c[k].lo;
+        out[len++] = c[k].mark;
+    }
+    return len;
+}
+
+uint32_t occ_decode_delta(const uint8_t *in, size_t len, occ_change *out, uint32_t max)
+{
+    uint32_t n = 0;
+    for (size_t k = 0; k + OCC_DELTA_RECORD <= len && n < max; k += OCC_DELTA_RECORD, n++) {
+        uint16_t cell = (uint16_t)((in[k] << 8) | in[k + 1]);
+        out[n].x    = cell % OCC_CELLS;
+        out[n].y    = cell / OCC_CELLS;
+        out[n].lo   = (int8_t)in[k + 2];
+        out[n].mark = in[k + 3];
+    }
+    return n;
+}
+
+occ_mark occ_mark_from_colour(colour_class c)
+{
+    static const occ_mark marks[COLOUR_CLASSES] = {
+        [COLOUR_UNKNOWN] = OCC_MARK_NONE,
+        [COLOUR_BLACK]   = OCC_MARK_CRATER,
+        [COLOUR_WHITE]   = OCC_MARK_WHITE,
+        [COLOUR_RED]     = OCC_MARK_RED,
+        [COLOUR_GREEN]   = OCC_MARK_GREEN,
+        [COLOUR_BLUE]    = OCC_MARK_BLUE,
+    };
+    return (unsigned)c < COLOUR_CLASSES ? marks[c] : OCC_MARK_NONE;
+}
@@ -0,0 +1,103 @@
+#ifndef OCC_GRID_H
+#define OCC_GRID_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "colour_class.h"
+
+/*
+ * Occupancy grid map built on the robot.
+ *
+ * The arena is OCC_CELLS x OCC_CELLS cells of OCC_CELL_MM, centred on the
+ * pose origin. Each cell holds a log-odds occupancy (int8, positive =
+ * occupied) and a mark from the colour sensors. Cells are stored in
+ * OCC_TILE x OCC_TILE tiles so a tile's log-odds fill one 64-byte cache
+ * line and a ray, which stays local, touches few lines.
+ *
+ * A range reading is ray cast from the sensor: cells it crossed become
+ * more likely free, the cell it ended in more likely occupied. A reading
+ * at or beyond OCC_MAX_RANGE_MM only clears cells.
+ *
+ * Changes are tracked per cell; occ_take_changes hands out the cells that
+ * changed since they were last taken. A log-odds change only counts once
+ * it moves the cell to another OCC_LO_QUANTUM step, so repeated sightings
+ * of a settled cell cost nothing on the link. The delta encoding is
+ * OCC_DELTA_RECORD bytes per cell:
+ *
+ *   cell  u16    y * OCC_CELLS + x, big-endian
+ *   lo    i8     log-odds
+ *   mark  u8     occ_mark
+ *
+ * All functions are thread-safe.
+ */
+
+#define OCC_CELL_MM       20
+#define OCC_TILE          8                       /* cells per tile side  */
+#define OCC_TILES         32                      /* tiles per grid side  */
+#define OCC_CELLS         (OCC_TILE * OCC_TILES)  /* 256: 5.12 m          */
+#define OCC_MAX_RANGE_MM  1200
+#define OCC_LO_HIT        12
+#define OCC_LO_MISS       (-3)
+#define OCC_LO_MAX        96
+#define OCC_LO_QUANTUM    8
+#define OCC_DELTA_RECORD  4
+
+/* what the colour sensors saw on the floor */
+typedef enum {
+    OCC_MARK_NONE = 0,
+    OCC_MARK_CRATER,          /* black: crater or arena boundary */
+    OCC_MARK_RED,             /* coloured: block                 */
+    OCC_MARK_GREEN,
+    OCC_MARK_BLUE,
+    OCC_MARK_WHITE
+} occ_mark;
+
+typedef struct occ_tile {
+    int8_t   lo[OCC_TILE * OCC_TILE] __attribute__((aligned(64)));
+    uint8_t  mark[OCC_TILE * OCC_TILE];
+    int8_t   sent[OCC_TILE * OCC_TILE];   /* log-odds step last taken */
+    uint64_t dirty;                       /* one bit per cell         */
+} occ_tile;
+
+typedef struct occ_change {
+    uint16_t x, y;            /* cell coordinates */
+    int8_t   lo;
+    uint8_t  mark;
+} occ_change;
+
+/* Handle for one grid, do not modify directly */
+typedef struct occ_grid {
+    pthread_mutex_t lock;
+    occ_tile        tile[OCC_TILES * OCC_TILES];
+    uint32_t        dirty_tiles;          /* tiles with dirty != 0 */
+    uint32_t        next_tile;            /* where taking resumes  */
+} occ_grid;
+
+int  occ_init(occ_grid *g);
+void occ_destroy(occ_grid *g);
+
+/* Ray cast a range seen from (x_mm, y_mm) along heading (rad); distance_mm
+ * < 0 = no reading, ignored */
+void occ_add_range(occ_grid *g, float x_mm, float y_mm, float heading, int distance_mm);
+
+/* Record what a floor sensor at (x_mm, y_mm) sees; OCC_MARK_CRATER also
+ * makes the cell occupied */
+void occ_mark_cell(occ_grid *g, float x_mm, float y_mm, occ_mark mark);
+
+/* Log-odds and mark of the cell containing a point; returns 1 off the map */
+int  occ_get(occ_grid *g, float x_mm, float y_mm, int8_t *lo, occ_mark *mark);
+
+/* Take up to max changed cells, round-robin over the tiles; returns the
+ * count. Cells not taken stay changed. */
+uint32_t occ_take_changes(occ_grid *g, occ_change *out, uint32_t max);
+
+/* Encode / decode changes as OCC_DELTA_RECORD-byte records; encode
+ * returns bytes written, decode the records read */
+size_t   occ_encode_delta(const occ_change *c, uint32_t n, uint8_t *out, size_t cap);
+uint32_t occ_decode_delta(const uint8_t *in, size_t len, occ_change *out, uint32_t max);
+
+/* floor colour class (colour_classify) to a mark */
+occ_mark occ_mark_from_colour(colour_class c);
+
+#endif /* OCC_GRID_H */
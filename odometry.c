@@ -0,0 +1,144 @@
+#include "odometry.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static float wrap_angle(float a)
+{
+    while (a > (float)M_PI)   a -= 2.0f * (float)M_PI;
+    while (a <= -(float)M_PI) a += 2.0f * (float)M_PI;
+    return a;
+}
+
+int odom_init(odometry *od, const odom_geometry *geo, float gain)
+{
+    if (!od || !geo || geo->mm_per_step <= 0.0f || geo->wheel_base_mm <= 0.0f) return 1;
+    memset(od, 0, sizeof(*od));
+    od->geo  = *geo;
+    od->gain = gain;
+    od->pose.t_us = time_us();
+    return pthread_mutex_init(&od->lock, NULL) != 0;
+}
+
+void odom_destroy(odometry *od)
+{
+    if (od) pthread_mutex_destroy(&od->lock);
+}
+
+void odom_reset(odometry *od, float x_mm, float y_mm, float heading)
+{
+    pthread_mutex_lock(&od->lock);
+    od->pose.x_mm    = x_mm;
+    od->pose.y_mm    = y_mm;
+    od->pose.heading = wrap_angle(heading);
+    od->pose.t_us    = time_us();
+    od->ref_valid    = 0;
+    od->window_valid = 0;
+    od->consistent   = 0;
+    pthread_mutex_unlock(&od->lock);
+}
+
+void odom_add_steps(odometry *od, int32_t left, int32_t right)
+{
+    pthread_mutex_lock(&od->lock);
+    float dl = left * od->geo.mm_per_step, dr = right * od->geo.mm_per_step;
+    float ds = 0.5f * (dl + dr);
+    float dh = (dr - dl) / od->geo.wheel_base_mm;
+    float mid = od->pose.heading + 0.5f * dh;
+    od->pose.x_mm   += ds * cosf(mid);
+    od->pose.y_mm   += ds * sinf(mid);
+    od->pose.heading = wrap_angle(od->pose.heading + dh);
+    od->pose.t_us    = time_us();
+    od->wheel_mm    += ds;
+    pthread_mutex_unlock(&od->lock);
+}
+
+/* start comparing ranges from here; called with od->lock held */
+static void set_reference(odometry *od, float mm)
+{
+    od->ref_valid = 1;
+    od->ref_mm    = mm;
+    od->ref_pose  = od->pose;
+}
+
+/* Close the window once the wheels or the range moved ODOM_FUSE_WINDOW_MM
+ * and judge whether the range followed the wheels; called with od->lock
+ * held */
+static void check_window(odometry *od, float mm)
+{
+    if (!od->window_valid) {
+        od->window_valid    = 1;
+        od->window_mm       = mm;
+        od->window_wheel_mm = od->wheel_mm;
+        return;
+    }
+    float travel  = od->wheel_mm - od->window_wheel_mm;
+    float closing = od->window_mm - mm;
+    if (fabsf(travel) < ODOM_FUSE_WINDOW_MM && fabsf(closing) < ODOM_FUSE_WINDOW_MM) return;
+    od->consistent = fabsf(closing - travel) <= ODOM_FUSE_SLIP * fabsf(travel) + ODOM_FUSE_NOISE_MM;
+    od->window_mm       = mm;
+    od->window_wheel_mm = od->wheel_mm;
+}
+
+void odom_fuse_range(odometry *od, int distance_mm)
+{
+    pthread_mutex_lock(&od->lock);
+    if (distance_mm < 0 || distance_mm > ODOM_FUSE_MAX_MM) {
+        od->ref_valid    = 0;
+        od->window_valid = 0;
+        od->consistent   = 0;
+    } else if (!od->ref_valid
+               || fabsf(wrap_angle(od->pose.heading - od->ref_pose.heading)) > ODOM_FUSE_MAX_TURN) {
+        /* possibly another target: it has to prove itself again */
+        set_reference(od, (float)distance_mm);
+        od->window_valid = 0;
+        od->consistent   = 0;
+        check_window(od, (float)distance_mm);
+    } else {
+        check_window(od, (float)distance_mm);
+        if (!od->consistent) {
+            /* the target moves: its range says nothing about our travel */
+            od->suspended++;
+            set_reference(od, (float)distance_mm);
+        } else {
+            /* distance driven towards the target since the reference */
+            float h = od->ref_pose.heading;
+            float travel = (od->pose.x_mm - od->ref_pose.x_mm) * cosf(h)
+                         + (od->pose.y_mm - od->ref_pose.y_mm) * sinf(h);
+            float expected = od->ref_mm - travel;
+            float innov = (float)distance_mm - expected;
+            if (fabsf(innov) > ODOM_FUSE_GATE_MM) {
+                /* the target changed: compare from here on */
+                od->rejected++;
+                set_reference(od, (float)distance_mm);
+            } else {
+                /* a shorter range than expected means we got further */
+                float shift = -od->gain * innov;
+                od->pose.x_mm += shift * cosf(od->pose.heading);
+                od->pose.y_mm += shift * sinf(od->pose.heading);
+                od->fused++;
+                set_reference(od, expected + od->gain * innov);
+            }
+        }
+    }
+    pthread_mutex_unlock(&od->lock);
+}
+
+void odom_get(odometry *od, odom_pose *out)
+{
+    pthread_mutex_lock(&od->lock);
+    *out = od->pose;
+    pthread_mutex_unlock(&od->lock);
+}
@@ -0,0 +1,83 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Dead-reckoning pose from executed stepper steps.
+ *
+ * Differential drive: each batch of left/right steps is integrated as an
+ * arc (midpoint heading), so the pose follows curves as well as straight
+ * moves and turns on the spot. Feed it from the motion thread
+ * (motion_set_progress) and partially executed moves are counted exactly
+ * as far as they got.
+ *
+ * Forward ToF ranges correct the distance travelled: while the heading
+ * stays within ODOM_FUSE_MAX_TURN of where a range was taken, the next
+ * range should have shrunk by the distance driven towards the target. A
+ * difference within ODOM_FUSE_GATE_MM is blended in with `gain` (wheel
+ * slip, step loss); a larger one means the target changed, and the range
+ * becomes the new reference without being blended in.
+ *
+ * That only holds for a target that stands still. Every
+ * ODOM_FUSE_WINDOW_MM of wheel travel or range change, the range closed
+ * is compared with the wheel travel; ranges are only blended in while the
+ * two agreed within ODOM_FUSE_SLIP over the last window. A target moving
+ * with or towards the robot, or a robot standing still in front of a
+ * moving one, suspends fusion until a window agrees again.
+ *
+ * Frame: x along the heading at odom_reset, y to its left, heading in
+ * radians counter-clockwise in (-pi, pi]. All functions are thread-safe.
+ */
+
+#define ODOM_FUSE_GATE_MM    40.0f   /* larger innovations re-reference   */
+#define ODOM_FUSE_WINDOW_MM  50.0f   /* travel or range change per check  */
+#define ODOM_FUSE_SLIP       0.25f   /* range vs wheels, share of travel  */
+#define ODOM_FUSE_NOISE_MM   10.0f   /* ... plus this for range noise     */
+#define ODOM_FUSE_MAX_TURN   0.05f   /* rad of turn that voids a range    */
+#define ODOM_FUSE_MAX_MM     1200    /* ignore ranges beyond this         */
+
+typedef struct odom_geometry {
+    float mm_per_step;        /* wheel travel per step                */
+    float wheel_base_mm;      /* distance between the wheel contacts  */
+} odom_geometry;
+
+typedef struct odom_pose {
+    float    x_mm, y_mm;
+    float    heading;         /* rad                                  */
+    uint64_t t_us;            /* CLOCK_MONOTONIC time of the last update */
+} odom_pose;
+
+/* Handle for the estimator, do not modify directly */
+typedef struct odometry {
+    pthread_mutex_t lock;
+    odom_geometry   geo;
+    odom_pose       pose;
+    float           gain;         /* share of a range innovation applied */
+    int             ref_valid;
+    float           ref_mm;       /* fused range at ref_pose             */
+    odom_pose       ref_pose;
+    float           wheel_mm;     /* forward wheel travel, never fused   */
+    int             window_valid;
+    float           window_mm;    /* range and wheel_mm at window start  */
+    float           window_wheel_mm;
+    int             consistent;   /* the last window agreed              */
+    uint32_t        fused, rejected, suspended; /* ranges per outcome */
+} odometry;
+
+int  odom_init(odometry *od, const odom_geometry *geo, float gain);
+void odom_destroy(odometry *od);
+
+/* Set the pose, e.g. from a host fix; forgets the range reference */
+void odom_reset(odometry *od, float x_mm, float y_mm, float heading);
+
+/* Integrate steps taken (forward positive) */
+void odom_add_steps(odometry *od, int32_t left, int32_t right);
+
+/* Blend in a forward range; distance_mm < 0 = no reading */
+void odom_fuse_range(odometry *od, int distance_mm);
+
+void odom_get(odometry *od, odom_pose *out);
+
+#endif /* ODOMETRY_H */
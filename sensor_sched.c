@@ -0,0 +1,279 @@
+#include "sensor_sched.h"
+#include <libpynq.h>
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define SCHED_TOF_RETRY_MIN_US 500    /* ToF not ready when due: re-check after */
+#define SCHED_THREAD_IDLE_US   10000  /* longest sleep of the scheduler thread  */
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void sleep_until_us(uint64_t wake_us)
+{
+    struct timespec ts = {(time_t)(wake_us / 1000000ULL), (long)(wake_us % 1000000ULL) * 1000L};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+int sched_init(sensor_sched *s, tca9548a *mux)
+{
+    if (!s) return 1;
+    memset(s, 0, sizeof(*s));
+    s->mux      = mux;
+    s->start_us = time_us();
+    if (pthread_mutex_init(&s->lock, NULL)) return 1;
+    if (pthread_mutex_init(&s->bus, NULL)) return 1;
+
+    /* timed waits on CLOCK_MONOTONIC, immune to wall-clock steps */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_cond_init(&s->updated, &attr) != 0;
+    pthread_condattr_destroy(&attr);
+    return err;
+}
+
+void sched_destroy(sensor_sched *s)
+{
+    if (!s) return;
+    sched_stop(s);
+    pthread_cond_destroy(&s->updated);
+    pthread_mutex_destroy(&s->bus);
+    pthread_mutex_destroy(&s->lock);
+    s->count = 0;
+}
+
+static int select_channel(sensor_sched *s, uint8_t channel)
+{
+    if (channel == SCHED_NO_MUX || !s->mux) return 0;
+    return tca9548a_select_channel(s->mux, channel);
+}
+
+static int add_device(sensor_sched *s, sched_kind kind, uint8_t channel, void *dev)
+{
+    if (!s || !dev || s->count >= SCHED_MAX_DEVICES) return -1;
+    int slot = s->count;
+    s->dev[slot]    = dev;
+    s->due_us[slot] = 0;
+    pthread_mutex_lock(&s->lock);
+    memset(&s->latest.slot[slot], 0, sizeof(sched_sample));
+    s->latest.slot[slot].kind    = kind;
+    s->latest.slot[slot].channel = channel;
+    s->latest.count = ++s->count;
+    pthread_mutex_unlock(&s->lock);
+    return slot;
+}
+
+int sched_add_tof(sensor_sched *s, uint8_t channel, vl53x *tof, uint32_t period_ms)
+{
+    if (!s || !tof || select_channel(s, channel)) return -1;
+    if (tofStartContinuous(tof, period_ms)) return -1;
+    int slot = add_device(s, SCHED_TOF, channel, tof);
+    if (slot >= 0) {
+        static const tof_filter_cfg defaults = TOF_FILTER_DEFAULTS;
+        s->due_us[slot] = tof->next_ready_us;
+        tof_filter_init(&s->filter[slot], &defaults);
+    }
+    return slot;
+}
+
+int sched_set_tof_filter(sensor_sched *s, int slot, const tof_filter_cfg *cfg)
+{
+    if (!s || slot < 0 || slot >= s->count || s->latest.slot[slot].kind != SCHED_TOF) return 1;
+    pthread_mutex_lock(&s->bus);     /* the filter is fed while servicing */
+    tof_filter_init(&s->filter[slot], cfg);
+    pthread_mutex_unlock(&s->bus);
+    return 0;
+}
+
+int sched_add_colour(sensor_sched *s, uint8_t channel, tcs3472 *tcs)
+{
+    int slot = add_device(s, SCHED_COLOUR, channel, tcs);
+    if (slot >= 0) s->due_us[slot] = tcs->next_sample_us;
+    return slot;
+}
+
+/* collect one device's result; returns 1 when a new sample was published */
+static int service_slot(sensor_sched *s, int slot, uint64_t now)
+{
+    sched_sample *pub = &s->latest.slot[slot];
+    sched_kind kind = pub->kind;             /* fixed after add_device */
+    uint8_t channel = pub->channel;
+    int fresh = 0;
+
+    if (select_channel(s, channel)) {
+        s->due_us[slot] = now + SCHED_TOF_RETRY_MIN_US;
+        return 0;
+    }
+
+    if (kind == SCHED_TOF) {
+        vl53x *tof = s->dev[slot];
+        uint16_t mm;
+        int err = tofPollContinuous(tof, &mm);
+        if (err == VL53X_OK) {
+            tof_filter_add(&s->filter[slot], mm, tof->range_status, now);
+            pthread_mutex_lock(&s->lock);
+            pub->distance_mm  = mm;
+            pub->range_status = tof->range_status;
+            tof_filter_get(&s->filter[slot], now, &pub->filtered);
+            pub->t_us = now; pub->valid = 1; pub->count++;
+            pthread_cond_broadcast(&s->updated);
+            pthread_mutex_unlock(&s->lock);
+            fresh = 1;
+            s->due_us[slot] = tof->next_ready_us;
+        } else {
+            /* late: re-check at 1/16 of the period */
+            uint32_t retry = tof->period_us / 16;
+            s->due_us[slot] = now + (retry > SCHED_TOF_RETRY_MIN_US ? retry : SCHED_TOF_RETRY_MIN_US);
+        }
+    } else {
+        tcs3472 *tcs = s->dev[slot];
+        tcsSample sample;
+        if (tcs_poll_reading(tcs, &sample) == TCS3472_READY) {
+            pthread_mutex_lock(&s->lock);
+            pub->rgb  = sample.rgb;
+            pub->t_us = sample.t_us; pub->valid = 1; pub->count++;
+            pthread_cond_broadcast(&s->updated);
+            pthread_mutex_unlock(&s->lock);
+            fresh = 1;
+        }
+        /* the driver tracks when the next integration completes */
+        s->due_us[slot] = tcs->next_sample_us;
+    }
+    return fresh;
+}
+
+int sched_service(sensor_sched *s)
+{
+    int fresh = 0;
+    pthread_mutex_lock(&s->bus);
+    uint64_t start = time_us();
+
+    /* earliest due first, until nothing is due */
+    while (1) {
+        int next = -1;
+        uint64_t now = time_us();
+        for (int i = 0; i < s->count; i++)
+            if (s->due_us[i] <= now && (next < 0 || s->due_us[i] < s->due_us[next])) next = i;
+        if (next < 0) break;
+        fresh += service_slot(s, next, now);
+    }
+    s->busy_us += time_us() - start;
+    pthread_mutex_unlock(&s->bus);
+    return fresh;
+}
+
+/* when the next device is due, but at most max_wait_us from now */
+static uint64_t next_wake_us(sensor_sched *s, uint32_t max_wait_us)
+{
+    uint64_t wake = time_us() + max_wait_us;
+    for (int i = 0; i < s->count; i++)
+        if (s->due_us[i] < wake) wake = s->due_us[i];
+    return wake;
+}
+
+void sched_wait(sensor_sched *s, uint32_t max_wait_us)
+{
+    sched_service(s);
+    sleep_until_us(next_wake_us(s, max_wait_us));
+}
+
+static int is_stale(sensor_sched *s, uint32_t slots, uint64_t since)
+{
+    for (int i = 0; i < s->count; i++)
+        if ((slots & (1u << i)) && (!s->latest.slot[i].valid || s->latest.slot[i].t_us < since))
+            return 1;
+    return 0;
+}
+
+int sched_refresh(sensor_sched *s, uint32_t slots, uint64_t deadline_us)
+{
+    uint64_t since = time_us();
+
+    if (s->running) {
+        /* the scheduler thread publishes; wait for it */
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t wait_us = deadline_us > since ? deadline_us - since : 0;
+        ts.tv_sec  += (time_t)(wait_us / 1000000ULL);
+        ts.tv_nsec += (long)(wait_us % 1000000ULL) * 1000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+
+        int stale, err = 0;
+        pthread_mutex_lock(&s->lock);
+        while ((stale = is_stale(s, slots, since)) && err == 0)
+            err = pthread_cond_timedwait(&s->updated, &s->lock, &ts);
+        pthread_mutex_unlock(&s->lock);
+        return stale;
+    }
+
+    while (1) {
+        sched_service(s);
+
+        pthread_mutex_lock(&s->lock);
+        int stale = is_stale(s, slots, since);
+        pthread_mutex_unlock(&s->lock);
+        if (!stale) return 0;
+
+        uint64_t now = time_us();
+        if (now >= deadline_us) return 1;
+        sched_wait(s, (uint32_t)(deadline_us - now));
+    }
+}
+
+static void *sched_thread(void *arg)
+{
+    sensor_sched *s = arg;
+    while (s->running) {
+        if (sched_service(s) && s->on_sample) {
+            sensor_snapshot snap;
+            sched_snapshot(s, &snap);
+            s->on_sample(&snap, s->ctx);
+        }
+        sleep_until_us(next_wake_us(s, SCHED_THREAD_IDLE_US));
+    }
+    return NULL;
+}
+
+int sched_start(sensor_sched *s, sched_callback on_sample, void *ctx)
+{
+    if (!s || s->running) return 1;
+    s->on_sample = on_sample;
+    s->ctx       = ctx;
+    s->running   = 1;
+    if (pthread_create(&s->thread, NULL, sched_thread, s)) {
+        s->running = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void sched_stop(sensor_sched *s)
+{
+    if (!s || !s->running) return;
+    s->running = 0;
+    pthread_join(s->thread, NULL);
+}
+
+void sched_bus_lock(sensor_sched *s)   { pthread_mutex_lock(&s->bus); }
+void sched_bus_unlock(sensor_sched *s) { pthread_mutex_unlock(&s->bus); }
+
+void sched_snapshot(sensor_sched *s, sensor_snapshot *out)
+{
+    pthread_mutex_lock(&s->lock);
+    *out = s->latest;
+    pthread_mutex_unlock(&s->lock);
+}
+
+float sched_bus_occupancy(sensor_sched *s)
+{
+    uint64_t elapsed = time_us() - s->start_us;
+    return elapsed ? (float)s->busy_us / (float)elapsed : 0.0f;
+}
@@ -0,0 +1,121 @@
+#ifndef SENSOR_SCHED_H
+#define SENSOR_SCHED_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <libpynq.h>
+
+#include "TCA9548A.h"
+#include "vl53l0x.h"
+#include "tcs3472.h"
+#include "tof_filter.h"
+
+/*
+ * Sensor scheduler.
+ *
+ * The VL53L0X (continuous mode) and the TCS3472 convert on their own once
+ * started, so the CPU only needs to be on the bus to collect results. The
+ * scheduler knows when each registered device will next have data, services
+ * whichever is due first (selecting its mux channel) and publishes the
+ * latest samples to a snapshot other code can copy at any time.
+ *
+ * Every ToF reading is also run through a tof_filter (TOF_FILTER_DEFAULTS
+ * unless sched_set_tof_filter changes it); the sample carries both the raw
+ * reading and the filtered estimate.
+ *
+ * The scheduler can run on its own thread (sched_start); otherwise
+ * sched_service/sched_wait must be called from one thread. sched_snapshot
+ * and sched_refresh may be called from any thread. Code that talks to a
+ * registered device directly must hold sched_bus_lock.
+ */
+
+#define SCHED_MAX_DEVICES 8
+#define SCHED_NO_MUX      0xFF   /* device is on the root bus */
+
+typedef enum { SCHED_TOF, SCHED_COLOUR } sched_kind;
+
+/* Latest result of one device */
+typedef struct sched_sample {
+    sched_kind   kind;
+    uint8_t      channel;
+    uint8_t      valid;         /* at least one sample taken          */
+    uint32_t     count;         /* samples since sched_init           */
+    uint64_t     t_us;          /* CLOCK_MONOTONIC time of the sample */
+    uint16_t     distance_mm;   /* SCHED_TOF: raw reading             */
+    uint8_t      range_status;  /* SCHED_TOF: its VL53X range status  */
+    tof_estimate filtered;      /* SCHED_TOF: estimate after it       */
+    tcsReading   rgb;           /* SCHED_COLOUR                       */
+} sched_sample;
+
+typedef struct sensor_snapshot {
+    uint8_t      count;
+    sched_sample slot[SCHED_MAX_DEVICES];
+} sensor_snapshot;
+
+/* Called on the scheduler thread after new samples were published */
+typedef void (*sched_callback)(const sensor_snapshot *snap, void *ctx);
+
+/* Handle for one scheduler, do not modify directly */
+typedef struct sensor_sched {
+    tca9548a       *mux;
+    uint8_t         count;
+    void           *dev[SCHED_MAX_DEVICES];     /* vl53x * or tcs3472 * */
+    uint64_t        due_us[SCHED_MAX_DEVICES];
+    tof_filter      filter[SCHED_MAX_DEVICES];  /* SCHED_TOF slots       */
+    uint64_t        start_us;
+    uint64_t        busy_us;                    /* time spent on the bus */
+    pthread_mutex_t lock;                       /* guards `latest`       */
+    pthread_cond_t  updated;                    /* `latest` changed      */
+    pthread_mutex_t bus;                        /* held while servicing  */
+    sensor_snapshot latest;
+    pthread_t       thread;
+    _Atomic int     running;                    /* cleared by sched_stop */
+    sched_callback  on_sample;
+    void           *ctx;
+} sensor_sched;
+
+/* mux may be NULL when every device is on the root bus */
+int  sched_init(sensor_sched *s, tca9548a *mux);
+void sched_destroy(sensor_sched *s);
+
+/* Register an initialised VL53L0X and start continuous ranging with
+ * period_ms (0 = back-to-back). Returns the slot index, -1 on error. */
+int  sched_add_tof(sensor_sched *s, uint8_t channel, vl53x *tof, uint32_t period_ms);
+
+/* Replace the filter of a ToF slot; its history is dropped. Returns 0 on
+ * success, 1 if the slot is not a ToF. */
+int  sched_set_tof_filter(sensor_sched *s, int slot, const tof_filter_cfg *cfg);
+
+/* Register an initialised TCS3472. Returns the slot index, -1 on error. */
+int  sched_add_colour(sensor_sched *s, uint8_t channel, tcs3472 *tcs);
+
+/* Collect results from every device that is due now.
+ * Returns the number of new samples published. */
+int  sched_service(sensor_sched *s);
+
+/* sched_service, then sleep until the next device is due but at most
+ * max_wait_us. */
+void sched_wait(sensor_sched *s, uint32_t max_wait_us);
+
+/* Service until every slot in `slots` (bit i = slot i) has a sample taken
+ * after this call or until deadline_us. Returns 0 when all are fresh, 1 on
+ * timeout. */
+int  sched_refresh(sensor_sched *s, uint32_t slots, uint64_t deadline_us);
+
+/* Service devices on a background thread until sched_stop. on_sample may
+ * be NULL. Returns 0 on success. */
+int  sched_start(sensor_sched *s, sched_callback on_sample, void *ctx);
+void sched_stop(sensor_sched *s);
+
+/* Exclusive access to the bus and the registered devices */
+void sched_bus_lock(sensor_sched *s);
+void sched_bus_unlock(sensor_sched *s);
+
+/* Copy of the latest samples */
+void sched_snapshot(sensor_sched *s, sensor_snapshot *out);
+
+/* Fraction of wall time spent on the bus since sched_init */
+float sched_bus_occupancy(sensor_sched *s);
+
+#endif /* SENSOR_SCHED_H */
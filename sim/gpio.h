@@ -0,0 +1,16 @@
+/* Host-side stand-in for libpynq's gpio.h (subset). */
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <pinmap.h>
+
+typedef enum { GPIO_DIR_INPUT = 0, GPIO_DIR_OUTPUT = 1 } gpio_direction_t;
+typedef enum { GPIO_LEVEL_LOW = 0, GPIO_LEVEL_HIGH = 1 } gpio_level_t;
+
+extern void gpio_init(void);
+extern void gpio_destroy(void);
+extern void gpio_set_direction(const io_t pin, const gpio_direction_t direction);
+extern void gpio_set_level(const io_t pin, const gpio_level_t level);
+extern gpio_level_t gpio_get_level(const io_t pin);
+
+#endif /* GPIO_H */
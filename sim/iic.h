@@ -0,0 +1,20 @@
+/* Host-side stand-in for libpynq's iic.h (subset). */
+#ifndef IIC_H
+#define IIC_H
+
+#include <stdint.h>
+
+typedef enum { IIC0 = 0, IIC1 = 1, NUM_IICS = 2 } iic_index_t;
+
+extern void iic_init(const iic_index_t iic);
+extern void iic_destroy(const iic_index_t iic);
+
+/* Both return 0 on success and 1 when the addressed device does not ACK. */
+extern int iic_read_register(const iic_index_t iic, const uint8_t addr,
+                             const uint8_t reg, uint8_t *data,
+                             uint16_t data_length);
+extern int iic_write_register(const iic_index_t iic, const uint8_t addr,
+                              const uint8_t reg, uint8_t *data,
+                              uint16_t data_length);
+
+#endif /* IIC_H */
@@ -0,0 +1,25 @@
+/*
+ *  Host-side stand-in for the libpynq umbrella header.
+ *
+ *  Only the parts of libpynq that our programs use are provided; see
+ *  pynq_sim.h for how the simulated board is configured.
+ */
+#ifndef LIBPYNQ_H
+#define LIBPYNQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pinmap.h>
+#include <util.h>
+#include <switchbox.h>
+#include <gpio.h>
+#include <iic.h>
+#include <uart.h>
+#include <stepper.h>
+
+/* Bring up the (simulated) board; reads the PYNQ_SIM_* environment. */
+extern void pynq_init(void);
+extern void pynq_destroy(void);
+
+#endif /* LIBPYNQ_H */
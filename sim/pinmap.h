@@ -0,0 +1,12 @@
+/* Host-side stand-in for libpynq's pin map (subset). */
+#ifndef PINMAP_H
+#define PINMAP_H
+
+typedef enum {
+  IO_AR0, IO_AR1, IO_AR2, IO_AR3, IO_AR4, IO_AR5, IO_AR6,
+  IO_AR7, IO_AR8, IO_AR9, IO_AR10, IO_AR11, IO_AR12, IO_AR13,
+  IO_AR_SCL, IO_AR_SDA,
+  NUM_IO
+} io_t;
+
+#endif /* PINMAP_H */
@@ -0,0 +1,1155 @@
+/*
+ *  pynq_sim - host-side replacement for the libpynq I2C/UART/stepper layer
+ *
+ *  See pynq_sim.h for the board model and how to build against it.
+ */
+
+#include <libpynq.h>
+#include "pynq_sim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_MUX_ADDR     0x70
+#define SIM_DEFAULT_ADDR 0x29
+#define SIM_RX_CAP       4096
+#define SIM_TX_FIFO      16
+#define SIM_MAX_CYCLES   4096
+
+/* ---------------------------------------------------------------- time -- */
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Sleep for long waits, spin for the last stretch so short bus transfers
+ * are charged accurately. */
+static void wait_until_ns(uint64_t deadline)
+{
+  uint64_t t = now_ns();
+  if (deadline > t + 200000)
+  {
+    uint64_t d = deadline - t - 100000;
+    struct timespec ts = {(time_t)(d / 1000000000ULL), (long)(d % 1000000000ULL)};
+    nanosleep(&ts, NULL);
+  }
+  while (now_ns() < deadline)
+    ;
+}
+
+void sleep_msec(int msec)
+{
+  if (msec <= 0) return;
+  struct timespec ts = {msec / 1000, (long)(msec % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+/* -------------------------------------------------------------- config -- */
+
+static uint32_t cfg_iic_hz[NUM_IICS] = {100000, 100000};
+static uint32_t cfg_iic_overhead_ns  = 10000;
+static uint32_t cfg_baud             = 115200;
+static uint32_t cfg_cycles           = 20;
+static uint32_t cfg_step_tick_ns     = 1000;
+static int      cfg_loopback         = 0;
+static uint32_t cfg_host_quiet_ns    = 2000000;
+static uint64_t cfg_host_timeout_ns  = 1000000000ULL;
+static int      cfg_framed           = 0;
+static int      cfg_binary           = 0;
+static uint32_t cfg_pipeline         = 1;
+static uint32_t cfg_pullin           = 3072;
+static uint32_t cfg_tof_mm           = 350;
+static uint32_t cfg_tof_noise_mm     = 3;
+static uint32_t cfg_tof_glitch       = 0;     /* per mille                 */
+static uint32_t cfg_tof_um_per_step  = 0;
+static uint32_t cfg_light_pct        = 100;
+static uint32_t cfg_crater_steps     = 0;
+static uint32_t cfg_ber_ppm          = 0;
+static uint32_t cfg_seed             = 1;
+static char     cfg_command[512]     = "{\"speed\":3072,\"left\":100,\"right\":100}";
+
+static uint32_t env_u32(const char *name, uint32_t def)
+{
+  const char *s = getenv(name);
+  return (s && *s) ? (uint32_t)strtoul(s, NULL, 0) : def;
+}
+
+/* ----------------------------------------------------------- I2C model -- */
+
+typedef struct {
+  pynq_sim_kind kind;
+  int      channel;
+  uint8_t  addr;
+  uint8_t  reset_addr;
+  uint8_t  page;            /* VL53L0X 0xFF page select                   */
+  int      xshut;           /* GPIO holding the device in reset, -1 none  */
+  uint8_t  reg[2][256];     /* [page != 0][register]                      */
+  unsigned seed;
+  /* VL53L0X */
+  int      mode;            /* 0 idle, 1 single, 2 back-to-back, 3 timed  */
+  uint64_t due_ns;
+  uint64_t period_ns;
+  uint16_t distance_mm;
+  /* TCS3472 */
+  uint64_t cycle_start_ns;
+  uint64_t cycles_seen;
+  uint16_t rate[4];         /* C, R, G, B counts per 2.4 ms at x1         */
+  uint32_t out_run;         /* consecutive cycles CLEAR was out of range  */
+} sim_dev;
+
+enum { VL_IDLE, VL_SINGLE, VL_BACK_TO_BACK, VL_TIMED };
+
+static pthread_mutex_t iic_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_dev  devs[PYNQ_SIM_MAX_DEVICES];
+static int      ndevs;
+static uint8_t  mux_ctrl;
+
+static uint64_t st_iic_xfers[NUM_IICS];
+static uint64_t st_iic_bytes[NUM_IICS];
+static uint64_t st_iic_busy_ns[NUM_IICS];
+static uint64_t st_iic_nacks[NUM_IICS];
+
+static int noise(sim_dev *d, int span)
+{
+  return span ? (rand_r(&d->seed) % (2 * span + 1)) - span : 0;
+}
+
+/* VL53L0X ---------------------------------------------------------------- */
+
+static void vl_reset(sim_dev *d)
+{
+  memset(d->reg, 0, sizeof(d->reg));
+  d->addr = d->reset_addr;
+  d->page = 0;
+  d->mode = VL_IDLE;
+  d->reg[0][0xC0] = 0xEE;           /* model id                          */
+  d->reg[0][0xC2] = 0x10;           /* revision                          */
+  d->reg[0][0x84] = 0x11;
+  d->reg[0][0xF8] = 0x0B;           /* oscillator calibration 0x0BEB     */
+  d->reg[0][0xF9] = 0xEB;
+  memset(&d->reg[0][0xB0], 0xFF, 6); /* reference SPAD map              */
+  d->reg[1][0x91] = 0x3C;           /* stop variable                     */
+  d->reg[1][0x92] = 0x85;           /* 5 aperture SPADs                  */
+}
+
+/* Conversion time derived from the final range timeout the driver
+ * programmed, plus the fixed start/pre-range overhead. */
+static uint64_t vl_conversion_ns(sim_dev *d)
+{
+  uint32_t pclks = ((uint32_t)d->reg[0][0x70] + 1) << 1;
+  uint32_t macro_ns = ((2304 * pclks * 1655) + 500) / 1000;
+  uint16_t enc = (uint16_t)((d->reg[0][0x71] << 8) | d->reg[0][0x72]);
+  uint8_t shift = (enc >> 8) > 16 ? 16 : (enc >> 8);
+  uint64_t mclks = ((uint64_t)(enc & 0xFF) << shift) + 1;
+  uint64_t us = (mclks * macro_ns) / 1000 + 4000;
+  if (us < 5000) us = 5000;
+  if (us > 500000) us = 500000;
+  return us * 1000;
+}
+
+static int32_t sim_forward_steps(void);
+
+static void vl_publish(sim_dev *d)
+{
+  uint8_t seq = d->reg[0][0x01];
+  if ((seq & 0xC0) == 0)
+  {
+    /* reference calibration pass: leave VHV / phase results behind */
+    if (seq & 0x01) d->reg[0][0xCB] = 0x1C;
+    if (seq & 0x02) d->reg[0][0xEE] = 0x0A;
+  }
+  else
+  {
+    int mm = d->distance_mm;
+    uint8_t status = 11;            /* range valid                        */
+    /* the target stands still while the robot drives towards it */
+    if (cfg_tof_um_per_step && mm < 8190)
+      mm -= (int)((int64_t)sim_forward_steps() * cfg_tof_um_per_step / 1000);
+    if (mm >= 8190) { mm = 8190; status = 4; }
+    /* never given a VHV setting: the SPADs are biased wrong */
+    else if ((d->reg[0][0xCB] & 0x7F) == 0) status = 1;
+    else
+    {
+      mm += noise(d, (int)cfg_tof_noise_mm);
+      if (mm < 20) mm = 20;
+    }
+    /* glitches: a random range, half of them flagged as a sigma fail, the
+     * other half (multipath, crosstalk) reported as valid */
+    if (cfg_tof_glitch && (uint32_t)(rand_r(&d->seed) % 1000) < cfg_tof_glitch)
+    {
+      mm = 20 + rand_r(&d->seed) % 2000;
+      status = (rand_r(&d->seed) & 1) ? 1 : 11;
+    }
+    d->reg[0][0x14] = (uint8_t)(status << 3);
+    d->reg[0][0x1E] = (uint8_t)(mm >> 8);
+    d->reg[0][0x1F] = (uint8_t)mm;
+  }
+  d->reg[0][0x13] = 0x04;           /* new sample ready                   */
+}
+
+static void vl_tick(sim_dev *d, uint64_t now)
+{
+  if (d->mode == VL_IDLE || now < d->due_ns) return;
+  vl_publish(d);
+  if (d->mode == VL_SINGLE)
+  {
+    d->mode = VL_IDLE;
+    return;
+  }
+  d->due_ns += d->period_ns;
+  if (d->due_ns <= now) d->due_ns = now + d->period_ns;
+}
+
+static void vl_write(sim_dev *d, uint8_t reg, uint8_t v, uint64_t now)
+{
+  if (reg == 0xFF) { d->page = v; return; }
+  if (d->page) { d->reg[1][reg] = v; return; }
+
+  d->reg[0][reg] = v;
+  switch (reg)
+  {
+    case 0x00: /* SYSRANGE_START */
+      d->reg[0][0x00] = 0;
+      if (v & 0x02)
+      {
+        d->mode = VL_BACK_TO_BACK;
+        d->period_ns = vl_conversion_ns(d);
+        d->due_ns = now + d->period_ns;
+      }
+      else if (v & 0x04)
+      {
+        uint32_t osc = ((uint32_t)d->reg[0][0xF8] << 8) | d->reg[0][0xF9];
+        uint32_t im = ((uint32_t)d->reg[0][0x04] << 24) | ((uint32_t)d->reg[0][0x05] << 16) |
+                      ((uint32_t)d->reg[0][0x06] << 8) | d->reg[0][0x07];
+        uint64_t period = (uint64_t)(osc ? im / osc : im) * 1000000ULL;
+        uint64_t conv = vl_conversion_ns(d);
+        d->mode = VL_TIMED;
+        d->period_ns = period > conv ? period : conv;
+        d->due_ns = now + conv;
+      }
+      else if (v & 0x01)
+      {
+        if (d->mode == VL_BACK_TO_BACK || d->mode == VL_TIMED)
+          d->mode = VL_IDLE;        /* single-shot write stops continuous */
+        else
+        {
+          d->mode = VL_SINGLE;
+          d->due_ns = now + (((d->reg[0][0x01] & 0xC0) == 0) ? 3000000ULL : vl_conversion_ns(d));
+        }
+      }
+      break;
+    case 0x0B: /* SYSTEM_INTERRUPT_CLEAR */
+      if (v & 0x01) d->reg[0][0x13] = 0;
+      break;
+    case 0x8A: /* I2C_SLAVE_DEVICE_ADDRESS */
+      d->addr = v & 0x7F;
+      break;
+  }
+}
+
+static uint8_t vl_read(sim_dev *d, uint8_t reg)
+{
+  if (reg == 0xFF) return d->page;
+  if (d->page)
+  {
+    /* NVM read strobe completes immediately */
+    if (reg == 0x83 && d->reg[1][0x83] == 0) return 0x10;
+    return d->reg[1][reg];
+  }
+  return d->reg[0][reg];
+}
+
+/* TCS3472 ---------------------------------------------------------------- */
+
+static void tcs_reset(sim_dev *d)
+{
+  memset(d->reg, 0, sizeof(d->reg));
+  d->addr = d->reset_addr;
+  d->reg[0][0x01] = 0xFF;           /* ATIME                              */
+  d->reg[0][0x12] = 0x44;           /* TCS34725                           */
+  d->cycles_seen = 0;
+  d->out_run = 0;
+}
+
+static uint64_t tcs_integration_ns(sim_dev *d)
+{
+  return (uint64_t)(256 - d->reg[0][0x01]) * 2400000ULL;
+}
+
+static void tcs_tick(sim_dev *d, uint64_t now)
+{
+  static const uint32_t gain_mult[4] = {1, 4, 16, 60};
+  uint8_t en = d->reg[0][0x00];
+  if ((en & 0x03) != 0x03 || now < d->cycle_start_ns) return;
+
+  uint64_t k = (now - d->cycle_start_ns) / tcs_integration_ns(d);
+  if (k == 0 || k == d->cycles_seen) return;
+  uint64_t ended = k - d->cycles_seen;
+  d->cycles_seen = k;
+
+  uint32_t steps = 256 - d->reg[0][0x01];
+  uint32_t sat = steps >= 64 ? 65535 : 1024 * steps;
+  uint32_t light = cfg_light_pct;
+  /* past the crater edge the floor reflects next to nothing */
+  if (cfg_crater_steps && sim_forward_steps() >= (int32_t)cfg_crater_steps) light = light / 20;
+  for (int ch = 0; ch < 4; ch++)
+  {
+    int64_t v = (int64_t)d->rate[ch] * steps * gain_mult[d->reg[0][0x0F] & 3] * light / 100;
+    v += v * noise(d, 10) / 1000;
+    if (v < 0) v = 0;
+    if (v > sat) v = sat;
+    d->reg[0][0x14 + 2 * ch] = (uint8_t)v;
+    d->reg[0][0x15 + 2 * ch] = (uint8_t)(v >> 8);
+  }
+  d->reg[0][0x13] |= 0x01;          /* AVALID                             */
+
+  /* clear-channel interrupt: AINT once CLEAR has been outside AILT..AIHT
+   * for the PERS number of cycles (PERS 0: every cycle) */
+  if (en & 0x10)
+  {
+    static const uint8_t pers_cycles[16] = {0, 1, 2, 3, 5, 10, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60};
+    uint16_t clear = (uint16_t)(d->reg[0][0x14] | (d->reg[0][0x15] << 8));
+    uint16_t low = (uint16_t)(d->reg[0][0x04] | (d->reg[0][0x05] << 8));
+    uint16_t high = (uint16_t)(d->reg[0][0x06] | (d->reg[0][0x07] << 8));
+    uint8_t need = pers_cycles[d->reg[0][0x0C] & 0x0F];
+    if (clear < low || clear > high) d->out_run += (uint32_t)ended;
+    else d->out_run = 0;
+    if (need == 0 || d->out_run >= need) d->reg[0][0x13] |= 0x10;
+  }
+}
+
+static void tcs_write(sim_dev *d, uint8_t reg, uint8_t v, uint64_t now)
+{
+  if (reg == 0x00 && (v & 0x02) && !(d->reg[0][0x00] & 0x02))
+  {
+    /* AEN rising edge: first cycle ends one integration after the
+     * 2.4 ms initialisation step */
+    d->cycle_start_ns = now + 2400000ULL;
+    d->cycles_seen = 0;
+    d->reg[0][0x13] &= ~0x01;
+  }
+  if (reg == 0x0C) d->out_run = 0;  /* new persistence filter           */
+  if (reg == 0x12 || reg == 0x13 || reg >= 0x14) return; /* read-only */
+  d->reg[0][reg] = v;
+}
+
+/* bus -------------------------------------------------------------------- */
+
+static void dev_tick(sim_dev *d, uint64_t now)
+{
+  if (d->kind == PYNQ_SIM_VL53L0X) vl_tick(d, now);
+  else tcs_tick(d, now);
+}
+
+static gpio_level_t gpio_levels[NUM_IO];
+
+static int dev_visible(sim_dev *d, iic_index_t iic, uint8_t addr)
+{
+  if (iic != IIC0 || d->addr != addr) return 0;
+  if (d->xshut >= 0 && gpio_levels[d->xshut] == GPIO_LEVEL_LOW) return 0;
+  return d->channel == PYNQ_SIM_NO_MUX || (mux_ctrl & (1u << d->channel));
+}
+
+static void dev_read(sim_dev *d, uint8_t reg, uint8_t *data, uint16_t len)
+{
+  if (d->kind == PYNQ_SIM_VL53L0X)
+  {
+    for (uint16_t i = 0; i < len; i++) data[i] = vl_read(d, (uint8_t)(reg + i));
+    return;
+  }
+  /* TCS3472: command byte selects repeated-byte or auto-increment */
+  uint8_t a = reg & 0x1F;
+  int inc = ((reg >> 5) & 0x03) == 0x01;
+  for (uint16_t i = 0; i < len; i++) data[i] = d->reg[0][(uint8_t)(a + (inc ? i : 0))];
+}
+
+static void dev_write(sim_dev *d, uint8_t reg, const uint8_t *data, uint16_t len, uint64_t now)
+{
+  if (d->kind == PYNQ_SIM_VL53L0X)
+  {
+    for (uint16_t i = 0; i < len; i++) vl_write(d, (uint8_t)(reg + i), data[i], now);
+    return;
+  }
+  uint8_t a = reg & 0x1F;
+  int inc = ((reg >> 5) & 0x03) == 0x01;
+  if (((reg >> 5) & 0x03) == 0x03)
+  {
+    /* special function: 0x06 clears the clear-channel interrupt */
+    if (a == 0x06)
+    {
+      d->reg[0][0x13] &= ~0x10;
+      d->out_run = 0;
+    }
+    return;
+  }
+  for (uint16_t i = 0; i < len; i++) tcs_write(d, (uint8_t)(a + (inc ? i : 0)), data[i], now);
+}
+
+static int sim_xfer(iic_index_t iic, uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len, int is_read)
+{
+  if (iic >= NUM_IICS) return 1;
+
+  pthread_mutex_lock(&iic_lock);
+  uint64_t start = now_ns();
+  /* START, address, register, [repeated START, address], data, STOP */
+  uint64_t bits = is_read ? (uint64_t)(3 + len) * 9 + 3 : (uint64_t)(2 + len) * 9 + 2;
+  uint64_t cost = bits * 1000000000ULL / cfg_iic_hz[iic] + cfg_iic_overhead_ns;
+
+  int acked = 0;
+  if (iic == IIC0 && addr == SIM_MUX_ADDR)
+  {
+    acked = 1;
+    if (is_read)
+    {
+      mux_ctrl = reg;
+      for (uint16_t i = 0; i < len; i++) data[i] = mux_ctrl;
+    }
+    else
+      mux_ctrl = len ? data[len - 1] : reg;
+  }
+  else
+  {
+    uint8_t tmp[256];
+    for (int i = 0; i < ndevs; i++)
+    {
+      sim_dev *d = &devs[i];
+      if (!dev_visible(d, iic, addr)) continue;
+      dev_tick(d, start);
+      if (is_read)
+      {
+        /* several responders on one address: open-drain wired-AND */
+        uint16_t n = len > sizeof(tmp) ? sizeof(tmp) : len;
+        dev_read(d, reg, tmp, n);
+        for (uint16_t j = 0; j < n; j++) data[j] = acked ? (data[j] & tmp[j]) : tmp[j];
+      }
+      else
+        dev_write(d, reg, data, len, start);
+      acked = 1;
+    }
+  }
+
+  if (!acked)
+  {
+    /* NACK after the address byte */
+    cost = 10 * 1000000000ULL / cfg_iic_hz[iic] + cfg_iic_overhead_ns;
+    st_iic_nacks[iic]++;
+  }
+  st_iic_xfers[iic]++;
+  st_iic_bytes[iic] += acked ? len : 0;
+  st_iic_busy_ns[iic] += cost;
+  wait_until_ns(start + cost);
+  pthread_mutex_unlock(&iic_lock);
+  return !acked;
+}
+
+void iic_init(const iic_index_t iic) { (void)iic; }
+void iic_destroy(const iic_index_t iic) { (void)iic; }
+
+int iic_read_register(const iic_index_t iic, const uint8_t addr, const uint8_t reg,
+                      uint8_t *data, uint16_t data_length)
+{
+  return sim_xfer(iic, addr, reg, data, data_length, 1);
+}
+
+int iic_write_register(const iic_index_t iic, const uint8_t addr, const uint8_t reg,
+                       uint8_t *data, uint16_t data_length)
+{
+  return sim_xfer(iic, addr, reg, data, data_length, 0);
+}
+
+int pynq_sim_attach(pynq_sim_kind kind, int channel, uint8_t addr)
+{
+  pthread_mutex_lock(&iic_lock);
+  int h = -1;
+  if (ndevs < PYNQ_SIM_MAX_DEVICES)
+  {
+    h = ndevs++;
+    sim_dev *d = &devs[h];
+    memset(d, 0, sizeof(*d));
+    d->kind = kind;
+    d->channel = channel;
+    d->reset_addr = addr;
+    d->seed = 0x5EED + (unsigned)h;
+    d->xshut = -1;
+    if (kind == PYNQ_SIM_VL53L0X)
+    {
+      vl_reset(d);
+      d->distance_mm = (uint16_t)cfg_tof_mm;
+    }
+    else
+    {
+      tcs_reset(d);
+      d->rate[0] = 30; d->rate[1] = 14; d->rate[2] = 9; d->rate[3] = 8;
+    }
+  }
+  pthread_mutex_unlock(&iic_lock);
+  return h;
+}
+
+void pynq_sim_detach_all(void)
+{
+  pthread_mutex_lock(&iic_lock);
+  ndevs = 0;
+  pthread_mutex_unlock(&iic_lock);
+}
+
+void pynq_sim_set_xshut(int dev, io_t pin)
+{
+  pthread_mutex_lock(&iic_lock);
+  if (dev >= 0 && dev < ndevs && pin < NUM_IO) devs[dev].xshut = pin;
+  pthread_mutex_unlock(&iic_lock);
+}
+
+void pynq_sim_set_distance(int dev, uint16_t mm)
+{
+  pthread_mutex_lock(&iic_lock);
+  if (dev >= 0 && dev < ndevs) devs[dev].distance_mm = mm;
+  pthread_mutex_unlock(&iic_lock);
+}
+
+void pynq_sim_set_colour(int dev, uint16_t r, uint16_t g, uint16_t b, uint16_t c)
+{
+  pthread_mutex_lock(&iic_lock);
+  if (dev >= 0 && dev < ndevs)
+  {
+    devs[dev].rate[0] = c; devs[dev].rate[1] = r;
+    devs[dev].rate[2] = g; devs[dev].rate[3] = b;
+  }
+  pthread_mutex_unlock(&iic_lock);
+}
+
+void pynq_sim_set_iic_speed(iic_index_t iic, uint32_t hz)
+{
+  if (iic < NUM_IICS && hz) cfg_iic_hz[iic] = hz;
+}
+
+/* ---------------------------------------------------------- UART model -- */
+
+/* The host's side of the frame.h and msg.h wire formats, written from the
+ * protocol description rather than linked from the robot's encoder, so a
+ * bug shared by the robot's encoder and decoder still shows up here. */
+#define HOST_FRAME_SYNC0   0xA5
+#define HOST_FRAME_SYNC1   0x5A
+#define HOST_FRAME_HEADER  6        /* sync x2, seq, len (BE), CRC-8     */
+#define HOST_FRAME_TRAILER 2        /* CRC-16/CCITT-FALSE (BE)           */
+#define HOST_MSG_MOVE      0x01
+#define HOST_MSG_VERSION   2
+#define HOST_MSG_MOVE_LEN  10       /* type, ver, id, speed, left, right */
+
+/* CRC-8, poly 0x07, init 0: check value 0xF4 */
+static uint8_t host_crc8(uint8_t crc, const uint8_t *p, uint32_t n)
+{
+  while (n--)
+  {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) crc = (uint8_t)((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0));
+  }
+  return crc;
+}
+
+/* CRC-16/CCITT-FALSE, poly 0x1021, init 0xFFFF: check value 0x29B1 */
+static uint16_t host_crc16(uint16_t crc, const uint8_t *p, uint32_t n)
+{
+  while (n--)
+  {
+    crc ^= (uint16_t)(*p++ << 8);
+    for (int k = 0; k < 8; k++) crc = (uint16_t)((crc << 1) ^ ((crc & 0x8000) ? 0x1021 : 0));
+  }
+  return crc;
+}
+
+/* the published check values over "123456789" */
+static int host_crc_selftest(void)
+{
+  static const uint8_t check[] = "123456789";
+  return host_crc8(0, check, 9) == 0xF4 && host_crc16(0xFFFF, check, 9) == 0x29B1;
+}
+
+static uint32_t host_frame(uint8_t *out, uint8_t seq, const uint8_t *body, uint32_t len)
+{
+  out[0] = HOST_FRAME_SYNC0;
+  out[1] = HOST_FRAME_SYNC1;
+  out[2] = seq;
+  out[3] = (uint8_t)(len >> 8);
+  out[4] = (uint8_t)len;
+  out[5] = host_crc8(0, out + 2, 3);
+  memcpy(out + HOST_FRAME_HEADER, body, len);
+  /* seq, len and payload; the header CRC is not covered */
+  uint16_t crc = host_crc16(host_crc16(0xFFFF, out + 2, 3), body, len);
+  out[HOST_FRAME_HEADER + len]     = (uint8_t)(crc >> 8);
+  out[HOST_FRAME_HEADER + len + 1] = (uint8_t)crc;
+  return HOST_FRAME_HEADER + len + HOST_FRAME_TRAILER;
+}
+
+typedef struct {
+  uint8_t  buf[SIM_RX_CAP];
+  uint64_t at_ns[SIM_RX_CAP];       /* time each byte finishes arriving  */
+  uint32_t head, tail;
+  uint64_t tx_busy_ns;              /* transmitter shift register busy   */
+  uint64_t rx_bytes, tx_bytes;
+  uint8_t  tx_hdr[HOST_FRAME_HEADER];    /* header of the frame being sent    */
+  uint32_t tx_hdr_len, tx_left;     /* ... and bytes still to come       */
+  uint64_t tx_frames;               /* complete frames sent              */
+} sim_uart;
+
+static pthread_mutex_t uart_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_uart uarts[NUM_UARTS];
+
+/* scripted host on UART0 */
+#define SIM_MAX_PIPELINE 16
+static uint32_t host_cycles_done;
+static uint32_t host_sent;          /* commands sent, not counting resends  */
+static uint32_t host_in_flight;
+static uint64_t host_send_ns[SIM_MAX_PIPELINE];  /* oldest first           */
+static uint64_t host_done_ns;       /* end of the previous reply            */
+static uint64_t host_tx_mark;       /* tx_frames when last looked at        */
+static uint64_t host_sent_ns;       /* last (re)transmission of the command */
+static uint32_t host_retries;
+static uint32_t host_bit_errors;
+static uint8_t  host_seq;
+static uint32_t cycle_us[SIM_MAX_CYCLES];
+
+static uint64_t byte_ns(void) { return 10ULL * 1000000000ULL / cfg_baud; }
+
+static void rx_push_locked(sim_uart *u, const uint8_t *data, uint32_t len, uint64_t t)
+{
+  uint64_t last = (u->head != u->tail) ? u->at_ns[(u->tail + SIM_RX_CAP - 1) % SIM_RX_CAP] : 0;
+  if (last > t) t = last;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    uint32_t next = (u->tail + 1) % SIM_RX_CAP;
+    if (next == u->head) break;     /* overrun: drop like the real FIFO  */
+    t += byte_ns();
+    u->buf[u->tail] = data[i];
+    u->at_ns[u->tail] = t;
+    u->tail = next;
+  }
+}
+
+/* xorshift32, reproducible from PYNQ_SIM_SEED */
+static uint32_t sim_rand(void)
+{
+  cfg_seed ^= cfg_seed << 13;
+  cfg_seed ^= cfg_seed >> 17;
+  cfg_seed ^= cfg_seed << 5;
+  return cfg_seed;
+}
+
+/* value of "key": in a JSON command, def when absent */
+static int json_int(const char *json, const char *key, int def)
+{
+  char pat[32];
+  snprintf(pat, sizeof(pat), "\"%s\"", key);
+  const char *p = strstr(json, pat);
+  int v;
+  if (!p || !(p = strchr(p, ':')) || sscanf(p + 1, " %d", &v) != 1) return def;
+  return v;
+}
+
+/* Send the scripted command as command id, JSON or as a MSG_MOVE,
+ * in a length-prefixed or a frame.h frame, with PYNQ_SIM_UART_BER bit
+ * errors per million bits. */
+static void host_send_locked(sim_uart *u, uint64_t now, uint16_t id)
+{
+  uint8_t buf[sizeof(cfg_command) + 16 + HOST_FRAME_HEADER + HOST_FRAME_TRAILER];
+  uint8_t body[sizeof(cfg_command) + 16];
+  uint32_t len, n;
+  if (cfg_binary)
+  {
+    uint16_t f[4] = {id, (uint16_t)json_int(cfg_command, "speed", 3072),
+                     (uint16_t)json_int(cfg_command, "left", 0), (uint16_t)json_int(cfg_command, "right", 0)};
+    body[0] = HOST_MSG_MOVE;
+    body[1] = HOST_MSG_VERSION;
+    for (int i = 0; i < 4; i++)
+    {
+      body[2 + 2 * i] = (uint8_t)(f[i] >> 8);
+      body[3 + 2 * i] = (uint8_t)f[i];
+    }
+    len = HOST_MSG_MOVE_LEN;
+  }
+  else if (cfg_command[0] == '{' && !strstr(cfg_command, "\"id\""))
+    len = (uint32_t)snprintf((char *)body, sizeof(body), "{\"id\":%u,%s", id, cfg_command + 1);
+  else
+  {
+    len = (uint32_t)strlen(cfg_command);
+    memcpy(body, cfg_command, len);
+  }
+  if (cfg_framed)
+    n = host_frame(buf, host_seq++, body, len);
+  else
+  {
+    buf[0] = (uint8_t)(len >> 24); buf[1] = (uint8_t)(len >> 16);
+    buf[2] = (uint8_t)(len >> 8);  buf[3] = (uint8_t)len;
+    memcpy(buf + 4, body, len);
+    n = len + 4;
+  }
+  if (cfg_ber_ppm)
+    for (uint32_t i = 0; i < n; i++)
+      for (int b = 0; b < 8; b++)
+        if (sim_rand() % 1000000u < cfg_ber_ppm) { buf[i] ^= (uint8_t)(1u << b); host_bit_errors++; }
+  rx_push_locked(u, buf, n, now);
+  host_sent_ns = now;
+}
+
+/* Called when the robot finds the receive FIFO empty.  Once the robot has
+ * sent a whole reply frame and its transmitter has been quiet for
+ * PYNQ_SIM_HOST_QUIET_US,
+ * the oldest command in flight is complete, which closes a cycle at the
+ * end of its last byte. The host keeps PYNQ_SIM_PIPELINE commands in
+ * flight; a cycle starts when its command was sent or when the previous
+ * one completed, whichever is later, so with a pipeline it measures the
+ * spacing of replies rather than the round trip. A command the robot has
+ * not answered after PYNQ_SIM_HOST_TIMEOUT_US is sent again. Returns 1
+ * when the script is finished. */
+static int host_idle_locked(uint64_t now)
+{
+  sim_uart *u = &uarts[UART0];
+  if (cfg_loopback || u->head != u->tail) return 0;
+  if (host_in_flight)
+  {
+    if (u->tx_frames == host_tx_mark)
+    {
+      /* still working, or the command was lost on the line */
+      if (now - host_sent_ns >= cfg_host_timeout_ns)
+      {
+        host_retries++;
+        host_send_locked(u, now, (uint16_t)host_sent);
+      }
+      return 0;
+    }
+    if (u->tx_hdr_len || u->tx_left || now < u->tx_busy_ns + cfg_host_quiet_ns) return 0;
+    uint64_t start = host_send_ns[0] > host_done_ns ? host_send_ns[0] : host_done_ns;
+    if (host_cycles_done < SIM_MAX_CYCLES)
+      cycle_us[host_cycles_done] = (uint32_t)((u->tx_busy_ns - start) / 1000);
+    host_cycles_done++;
+    host_done_ns = u->tx_busy_ns;
+    host_tx_mark = u->tx_frames;
+    memmove(host_send_ns, host_send_ns + 1, --host_in_flight * sizeof(host_send_ns[0]));
+  }
+  if (host_cycles_done >= cfg_cycles) return 1;
+
+  while (host_in_flight < cfg_pipeline && host_sent < cfg_cycles)
+  {
+    host_send_locked(u, now, (uint16_t)++host_sent);
+    host_send_ns[host_in_flight++] = now;
+  }
+  host_tx_mark = u->tx_frames;
+  return 0;
+}
+
+void uart_init(const int uart) { (void)uart; }
+void uart_destroy(const int uart) { (void)uart; }
+
+void uart_reset_fifos(const int uart)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return;
+  pthread_mutex_lock(&uart_lock);
+  uarts[uart].head = uarts[uart].tail = 0;
+  pthread_mutex_unlock(&uart_lock);
+}
+
+bool uart_has_data(const int uart)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return false;
+  pthread_mutex_lock(&uart_lock);
+  sim_uart *u = &uarts[uart];
+  uint64_t now = now_ns();
+  int done = 0;
+  if (uart == UART0 && u->head == u->tail) done = host_idle_locked(now);
+  bool ready = u->head != u->tail && u->at_ns[u->head] <= now;
+  pthread_mutex_unlock(&uart_lock);
+  if (done)
+  {
+    pynq_sim_report(stderr);
+    exit(EXIT_SUCCESS);
+  }
+  return ready;
+}
+
+bool uart_has_space(const int uart)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return false;
+  pthread_mutex_lock(&uart_lock);
+  bool space = uarts[uart].tx_busy_ns <= now_ns() + SIM_TX_FIFO * byte_ns();
+  pthread_mutex_unlock(&uart_lock);
+  return space;
+}
+
+uint8_t uart_recv(const int uart)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return 0;
+  while (!uart_has_data(uart))
+  {
+    struct timespec ts = {0, 20000};
+    nanosleep(&ts, NULL);
+  }
+  pthread_mutex_lock(&uart_lock);
+  sim_uart *u = &uarts[uart];
+  uint8_t b = u->buf[u->head];
+  u->head = (u->head + 1) % SIM_RX_CAP;
+  u->rx_bytes++;
+  pthread_mutex_unlock(&uart_lock);
+  return b;
+}
+
+/* Follow the headers of the robot's frames (length-prefixed, or frame.h
+ * when PYNQ_SIM_FRAMED) so the host only sees a reply once all of it is
+ * out, however long the robot stalls in the middle of one. */
+static void tx_track_locked(sim_uart *u, uint8_t b)
+{
+  if (u->tx_left)
+  {
+    if (--u->tx_left == 0) u->tx_frames++;
+    return;
+  }
+  if (cfg_framed && u->tx_hdr_len < 2 && b != (u->tx_hdr_len ? HOST_FRAME_SYNC1 : HOST_FRAME_SYNC0))
+  {
+    u->tx_hdr_len = 0;
+    return;
+  }
+  u->tx_hdr[u->tx_hdr_len++] = b;
+  if (u->tx_hdr_len < (cfg_framed ? HOST_FRAME_HEADER : 4u)) return;
+  const uint8_t *h = u->tx_hdr;
+  u->tx_left = cfg_framed ? (uint32_t)((h[3] << 8) | h[4]) + HOST_FRAME_TRAILER
+                          : ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | ((uint32_t)h[2] << 8) | h[3];
+  u->tx_hdr_len = 0;
+  if (!u->tx_left) u->tx_frames++;
+}
+
+void uart_send(const int uart, const uint8_t data)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return;
+  pthread_mutex_lock(&uart_lock);
+  sim_uart *u = &uarts[uart];
+  uint64_t now = now_ns();
+  if (u->tx_busy_ns < now) u->tx_busy_ns = now;
+  u->tx_busy_ns += byte_ns();
+  u->tx_bytes++;
+  if (uart == UART0) tx_track_locked(u, data);
+  if (cfg_loopback) rx_push_locked(u, &data, 1, now);
+  /* block while the transmit FIFO is full */
+  uint64_t free_at = u->tx_busy_ns - SIM_TX_FIFO * byte_ns();
+  pthread_mutex_unlock(&uart_lock);
+  if (free_at > now) wait_until_ns(free_at);
+}
+
+void pynq_sim_uart_inject(int uart, const uint8_t *data, uint32_t len)
+{
+  if (uart < 0 || uart >= NUM_UARTS) return;
+  pthread_mutex_lock(&uart_lock);
+  rx_push_locked(&uarts[uart], data, len, now_ns());
+  pthread_mutex_unlock(&uart_lock);
+}
+
+/* ------------------------------------------------------- stepper model -- */
+
+typedef struct {
+  uint16_t speed;
+  int32_t  remaining;
+  int32_t  position;
+  uint64_t t_ns;                    /* time of the last whole step        */
+  uint16_t last_speed;              /* period of the last step, 0 stopped */
+  uint32_t steps, unsafe;
+} sim_wheel;
+
+static pthread_mutex_t stepper_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_wheel wheels[2];
+static bool      stepper_on;
+
+/* A step is unsafe (a real motor would likely stall) when it starts from
+ * standstill faster than PYNQ_SIM_STEPPER_PULLIN, or is more than 1/8
+ * faster than the step before it. Only counted, the step still happens. */
+static void wheel_check_rate(sim_wheel *w, uint64_t n)
+{
+  uint16_t sp = w->speed ? w->speed : 1;
+  if (w->last_speed == 0 ? sp < cfg_pullin : (uint32_t)sp * 8 < (uint32_t)w->last_speed * 7)
+    w->unsafe++;
+  w->last_speed = sp;
+  w->steps += (uint32_t)n;
+}
+
+static void wheel_advance(sim_wheel *w, uint64_t now)
+{
+  if (!stepper_on || w->remaining == 0) { w->t_ns = now; w->last_speed = 0; return; }
+  uint64_t period = (uint64_t)(w->speed ? w->speed : 1) * cfg_step_tick_ns;
+  uint64_t n = (now - w->t_ns) / period;
+  if (n) wheel_check_rate(w, n);
+  uint32_t left = (uint32_t)(w->remaining > 0 ? w->remaining : -w->remaining);
+  if (n >= left) { n = left; w->t_ns = now; }
+  else w->t_ns += n * period;
+  int32_t step = w->remaining > 0 ? (int32_t)n : -(int32_t)n;
+  w->position += step;
+  w->remaining -= step;
+}
+
+static void wheels_advance(void)
+{
+  uint64_t now = now_ns();
+  wheel_advance(&wheels[0], now);
+  wheel_advance(&wheels[1], now);
+}
+
+void stepper_init(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  memset(wheels, 0, sizeof(wheels));
+  wheels[0].speed = wheels[1].speed = 0xFFFF;
+  stepper_on = false;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+void stepper_destroy(void) { stepper_disable(); }
+
+void stepper_reset(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  wheels[0].remaining = wheels[1].remaining = 0;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+void stepper_enable(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  stepper_on = true;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+void stepper_disable(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  stepper_on = false;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+void stepper_set_speed(uint16_t left_speed, uint16_t right_speed)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  wheels[0].speed = left_speed;
+  wheels[1].speed = right_speed;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+void stepper_steps(int16_t left, int16_t right)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  wheels[0].remaining = left;
+  wheels[1].remaining = right;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+bool stepper_steps_done(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  bool done = wheels[0].remaining == 0 && wheels[1].remaining == 0;
+  pthread_mutex_unlock(&stepper_lock);
+  return done;
+}
+
+void stepper_get_steps(int16_t *left, int16_t *right)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  if (left) *left = (int16_t)wheels[0].remaining;
+  if (right) *right = (int16_t)wheels[1].remaining;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+/* mean of both wheels' positions, forward positive */
+static int32_t sim_forward_steps(void)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  int32_t steps = (wheels[0].position + wheels[1].position) / 2;
+  pthread_mutex_unlock(&stepper_lock);
+  return steps;
+}
+
+void pynq_sim_stepper_position(int32_t *left, int32_t *right)
+{
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  if (left) *left = wheels[0].position;
+  if (right) *right = wheels[1].position;
+  pthread_mutex_unlock(&stepper_lock);
+}
+
+/* ------------------------------------------------------------ board --- */
+
+void gpio_init(void)
+{
+  for (int i = 0; i < NUM_IO; i++) gpio_levels[i] = GPIO_LEVEL_HIGH;
+}
+
+void gpio_destroy(void) {}
+void gpio_set_direction(const io_t pin, const gpio_direction_t direction)
+{
+  (void)pin;
+  (void)direction;
+}
+
+void gpio_set_level(const io_t pin, const gpio_level_t level)
+{
+  if (pin >= NUM_IO) return;
+  pthread_mutex_lock(&iic_lock);
+  /* releasing XSHUT boots the device with its power-on registers */
+  if (gpio_levels[pin] == GPIO_LEVEL_LOW && level == GPIO_LEVEL_HIGH)
+  {
+    for (int i = 0; i < ndevs; i++)
+    {
+      if (devs[i].xshut != (int)pin) continue;
+      if (devs[i].kind == PYNQ_SIM_VL53L0X) vl_reset(&devs[i]);
+      else tcs_reset(&devs[i]);
+    }
+  }
+  gpio_levels[pin] = level;
+  pthread_mutex_unlock(&iic_lock);
+}
+
+gpio_level_t gpio_get_level(const io_t pin)
+{
+  return pin < NUM_IO ? gpio_levels[pin] : GPIO_LEVEL_LOW;
+}
+
+void switchbox_init(void) {}
+void switchbox_destroy(void) {}
+void switchbox_set_pin(const io_t pin_number, const uint8_t pin_type)
+{
+  (void)pin_number;
+  (void)pin_type;
+}
+
+/* "tof:7,tcs:1,tcs:2" -> device models */
+static void parse_topology(const char *spec)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+  {
+    char kind[8] = "";
+    int channel = PYNQ_SIM_NO_MUX, xshut = -1, h = -1;
+    unsigned addr = SIM_DEFAULT_ADDR;
+    char *opt;
+    if (sscanf(tok, " %7[a-z]:%d", kind, &channel) < 2)
+    {
+      fprintf(stderr, "pynq_sim: bad topology entry '%s'\n", tok);
+      continue;
+    }
+    if ((opt = strchr(tok, '@'))) addr = (unsigned)strtoul(opt + 1, NULL, 16);
+    if ((opt = strchr(tok, '/'))) xshut = atoi(opt + 1);
+    if (strcmp(kind, "tof") == 0) h = pynq_sim_attach(PYNQ_SIM_VL53L0X, channel, (uint8_t)addr);
+    else if (strcmp(kind, "tcs") == 0) h = pynq_sim_attach(PYNQ_SIM_TCS3472, channel, (uint8_t)addr);
+    else fprintf(stderr, "pynq_sim: unknown device '%s'\n", kind);
+    if (h >= 0 && xshut >= 0) pynq_sim_set_xshut(h, (io_t)xshut);
+  }
+}
+
+void pynq_init(void)
+{
+  cfg_iic_hz[IIC0] = cfg_iic_hz[IIC1] = env_u32("PYNQ_SIM_IIC_HZ", 100000);
+  cfg_iic_overhead_ns = env_u32("PYNQ_SIM_IIC_OVERHEAD", 10) * 1000;
+  cfg_baud = env_u32("PYNQ_SIM_BAUD", 115200);
+  cfg_cycles = env_u32("PYNQ_SIM_CYCLES", 20);
+  cfg_step_tick_ns = env_u32("PYNQ_SIM_STEP_TICK_NS", 1000);
+  cfg_loopback = (int)env_u32("PYNQ_SIM_UART_LOOPBACK", 0);
+  cfg_host_quiet_ns = env_u32("PYNQ_SIM_HOST_QUIET_US", 2000) * 1000;
+  cfg_host_timeout_ns = env_u32("PYNQ_SIM_HOST_TIMEOUT_US", 1000000) * 1000ULL;
+  cfg_framed = (int)env_u32("PYNQ_SIM_FRAMED", 0);
+  cfg_binary = (int)env_u32("PYNQ_SIM_BINARY", 0);
+  cfg_pipeline = env_u32("PYNQ_SIM_PIPELINE", 1);
+  cfg_pullin = env_u32("PYNQ_SIM_STEPPER_PULLIN", 3072);
+  cfg_tof_mm = env_u32("PYNQ_SIM_TOF_MM", 350);
+  cfg_tof_noise_mm = env_u32("PYNQ_SIM_TOF_NOISE_MM", 3);
+  cfg_tof_glitch = env_u32("PYNQ_SIM_TOF_GLITCH", 0);
+  cfg_tof_um_per_step = env_u32("PYNQ_SIM_TOF_UM_PER_STEP", 0);
+  cfg_light_pct = env_u32("PYNQ_SIM_LIGHT", 100);
+  cfg_crater_steps = env_u32("PYNQ_SIM_CRATER_STEPS", 0);
+  if (cfg_pipeline < 1) cfg_pipeline = 1;
+  if (cfg_pipeline > SIM_MAX_PIPELINE) cfg_pipeline = SIM_MAX_PIPELINE;
+  cfg_ber_ppm = env_u32("PYNQ_SIM_UART_BER", 0);
+  cfg_seed = env_u32("PYNQ_SIM_SEED", 1);
+  if (!cfg_seed) cfg_seed = 1;
+  if (!cfg_iic_hz[IIC0] || !cfg_baud || !cfg_step_tick_ns)
+  {
+    fprintf(stderr, "pynq_sim: rates must be non-zero\n");
+    exit(EXIT_FAILURE);
+  }
+  if (!host_crc_selftest())
+  {
+    fprintf(stderr, "pynq_sim: host CRCs fail their check values\n");
+    exit(EXIT_FAILURE);
+  }
+  const char *cmd = getenv("PYNQ_SIM_COMMAND");
+  if (cmd && *cmd) snprintf(cfg_command, sizeof(cfg_command), "%s", cmd);
+
+  const char *topo = getenv("PYNQ_SIM_TOPOLOGY");
+  ndevs = 0;
+  mux_ctrl = 0;
+  gpio_init();
+  parse_topology((topo && *topo) ? topo : "tof:7,tcs:1,tcs:2");
+}
+
+void pynq_destroy(void)
+{
+  pynq_sim_report(stderr);
+}
+
+/* ----------------------------------------------------------- reporting -- */
+
+static int cmp_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+void pynq_sim_report(FILE *f)
+{
+  pthread_mutex_lock(&uart_lock);
+  uint32_t n = host_cycles_done < SIM_MAX_CYCLES ? host_cycles_done : SIM_MAX_CYCLES;
+  uint32_t sorted[SIM_MAX_CYCLES];
+  memcpy(sorted, cycle_us, n * sizeof(uint32_t));
+  uint64_t rx = uarts[UART0].rx_bytes, tx = uarts[UART0].tx_bytes;
+  uint32_t retries = host_retries, bit_errors = host_bit_errors;
+  pthread_mutex_unlock(&uart_lock);
+
+  if (n)
+  {
+    uint64_t sum = 0;
+    qsort(sorted, n, sizeof(uint32_t), cmp_u32);
+    for (uint32_t i = 0; i < n; i++) sum += sorted[i];
+    fprintf(f, "pynq_sim: %u cycles, latency ms min %.2f avg %.2f p50 %.2f p95 %.2f max %.2f\n",
+            n, sorted[0] / 1000.0, (double)sum / n / 1000.0, sorted[n / 2] / 1000.0,
+            sorted[(n * 95) / 100 < n ? (n * 95) / 100 : n - 1] / 1000.0, sorted[n - 1] / 1000.0);
+  }
+
+  pthread_mutex_lock(&iic_lock);
+  fprintf(f, "pynq_sim: iic0 %llu transactions, %llu data bytes, %.2f ms bus time, %llu nacks\n",
+          (unsigned long long)st_iic_xfers[IIC0], (unsigned long long)st_iic_bytes[IIC0],
+          st_iic_busy_ns[IIC0] / 1e6, (unsigned long long)st_iic_nacks[IIC0]);
+  if (n)
+    fprintf(f, "pynq_sim: per cycle %.1f transactions, %.2f ms bus time\n",
+            (double)st_iic_xfers[IIC0] / n, st_iic_busy_ns[IIC0] / 1e6 / n);
+  pthread_mutex_unlock(&iic_lock);
+  fprintf(f, "pynq_sim: uart0 rx %llu bytes, tx %llu bytes\n",
+          (unsigned long long)rx, (unsigned long long)tx);
+  pthread_mutex_lock(&stepper_lock);
+  wheels_advance();
+  fprintf(f, "pynq_sim: stepper %u/%u steps, %u/%u at an unsafe rate change\n",
+          wheels[0].steps, wheels[1].steps, wheels[0].unsafe, wheels[1].unsafe);
+  pthread_mutex_unlock(&stepper_lock);
+  if (retries || bit_errors)
+    fprintf(f, "pynq_sim: host %u bit errors injected, %u commands resent after timeout\n",
+            bit_errors, retries);
+}
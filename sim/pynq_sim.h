@@ -0,0 +1,143 @@
+/*
+ *  pynq_sim - host-side replacement for the libpynq I2C/UART/stepper layer
+ *
+ *  Link this instead of libpynq to run the rover programs on a plain Linux
+ *  box.  The headers in this directory shadow the libpynq ones, so build
+ *  with this directory first on the include path:
+ *
+ *    gcc -O2 -I sim -I . -x c Algorithm -x none \
+ *        TCA9548A.c tcs3472.c vl53l0x.c iic_profile.c sensor_sched.c motion.c \
+ *        uart_rx.c uart_tx.c frame.c msg.c json_cmd.c cmd_queue.c \
+ *        motion_profile.c odometry.c occ_grid.c tof_filter.c \
+ *        colour_class.c colour_lut.c \
+ *        sim/pynq_sim.c -lpthread -lm -o algo_sim
+ *
+ *  The other programs need only the drivers they use:
+ *
+ *    gcc -O2 -I sim -I . -x c "Distance + Colour sensors" -x none \
+ *        TCA9548A.c tcs3472.c vl53l0x.c colour_class.c colour_lut.c \
+ *        sim/pynq_sim.c -lpthread -lm -o dcs_sim
+ *    gcc -O2 -I sim -I . -x c "Colour calibration" -x none \
+ *        TCA9548A.c tcs3472.c colour_class.c colour_lut.c \
+ *        sim/pynq_sim.c -lpthread -lm -o colour_cal_sim
+ *
+ *  The scripted host encodes its commands with its own copy of the
+ *  frame.h / msg.h formats, so the sim itself needs neither frame.c nor
+ *  msg.c.
+ *
+ *  Add -DIIC_PROFILE for the per-register bus profile (iic_profile.h).
+ *  Add -DTOF_RING and tof_array.c for the VL53L0X ring, with e.g.
+ *  PYNQ_SIM_TOPOLOGY="tof:-1/8,tof:-1/9,tof:-1/10,tcs:1,tcs:2".
+ *
+ *  The simulated board has:
+ *    - a TCA9548A at 0x70 on IIC0 with VL53L0X / TCS3472 register models on
+ *      its downstream channels (or directly on the bus, channel -1);
+ *    - bus timing charged per bit at 100 kHz or 400 kHz plus a fixed
+ *      per-transaction driver overhead;
+ *    - a UART with a scripted host on the other end that sends one move
+ *      command each time the robot has drained its receive FIFO and gone
+ *      quiet after replying, so the time from command to the last reply
+ *      byte is one control-loop cycle (or keeps several in flight, see
+ *      PYNQ_SIM_PIPELINE);
+ *    - a virtual stepper that executes steps in real time and counts steps
+ *      taken at a rate change a real motor would likely miss.
+ *
+ *  Environment (read by pynq_init):
+ *    PYNQ_SIM_IIC_HZ        bus clock, default 100000
+ *    PYNQ_SIM_IIC_OVERHEAD  per-transaction overhead in us, default 10
+ *    PYNQ_SIM_TOPOLOGY      e.g. "tof:7,tcs:1,tcs:2" (the default); a device
+ *                           is kind:channel[@addr][/xshut], channel -1 = no
+ *                           mux, xshut = IO_ARn pin that holds it in reset
+ *    PYNQ_SIM_BAUD          UART baud rate, default 115200
+ *    PYNQ_SIM_CYCLES        commands the host sends before the simulation
+ *                           reports and exits, default 20
+ *    PYNQ_SIM_COMMAND       payload sent each cycle, default
+ *                           {"speed":3072,"left":100,"right":100}; an
+ *                           "id" numbering the commands is added unless
+ *                           the payload has one
+ *    PYNQ_SIM_STEP_TICK_NS  length of one stepper speed tick, default 1000
+ *    PYNQ_SIM_STEPPER_PULLIN fastest period a wheel can start at from
+ *                           standstill, default 3072; steps started faster,
+ *                           or more than 1/8 faster than the previous step,
+ *                           are reported as unsafe
+ *    PYNQ_SIM_TOF_MM        distance VL53L0X models start out seeing,
+ *                           default 350
+ *    PYNQ_SIM_TOF_NOISE_MM  VL53L0X ranging noise, +- mm uniform, default 3
+ *    PYNQ_SIM_TOF_GLITCH    VL53L0X readings per mille replaced by a random
+ *                           range, half flagged as sigma fail, default 0
+ *    PYNQ_SIM_TOF_UM_PER_STEP  if set, how far the robot really moves per
+ *                           step, in um: ranges shrink as it drives
+ *                           forward, towards a target that stands still
+ *    PYNQ_SIM_LIGHT         brightness TCS3472 models see, in percent of
+ *                           their set colour, default 100
+ *    PYNQ_SIM_CRATER_STEPS  if set, forward steps after which TCS3472 models
+ *                           see a black floor (5% of PYNQ_SIM_LIGHT)
+ *    PYNQ_SIM_UART_LOOPBACK set to 1 to loop transmitted bytes back into
+ *                           the receive FIFO instead of running the host
+ *    PYNQ_SIM_HOST_QUIET_US transmitter silence after which the host treats
+ *                           the robot as idle, default 2000
+ *    PYNQ_SIM_HOST_TIMEOUT_US resend an unanswered command after this long,
+ *                           default 1000000
+ *    PYNQ_SIM_FRAMED        set to 1 to send commands as frame.h frames
+ *                           (build the robot with -DUART_FRAMED)
+ *    PYNQ_SIM_BINARY        set to 1 to send the command as a msg.h
+ *                           MSG_MOVE instead of JSON
+ *    PYNQ_SIM_PIPELINE      commands the host keeps in flight, default 1;
+ *                           above 1 a cycle is the gap between replies
+ *    PYNQ_SIM_UART_BER      bit errors per million bits on host->robot
+ *                           bytes, default 0
+ *    PYNQ_SIM_SEED          seed for the injected errors, default 1
+ */
+#ifndef PYNQ_SIM_H
+#define PYNQ_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libpynq.h>
+
+#define PYNQ_SIM_MAX_DEVICES 8
+#define PYNQ_SIM_NO_MUX      (-1)
+
+typedef enum { PYNQ_SIM_VL53L0X, PYNQ_SIM_TCS3472 } pynq_sim_kind;
+
+/**
+ * @brief Add a device model to IIC0.
+ * @param kind device type
+ * @param channel mux channel 0-7, or PYNQ_SIM_NO_MUX for the root bus
+ * @param addr 7-bit address the device powers up with
+ * @return device handle, -1 when the table is full
+ */
+extern int pynq_sim_attach(pynq_sim_kind kind, int channel, uint8_t addr);
+
+/** @brief Remove every device model (the mux stays). */
+extern void pynq_sim_detach_all(void);
+
+/**
+ * @brief Wire a device's XSHUT input to a GPIO pin.
+ * The device is held in reset (and forgets its address) while the pin is
+ * driven low. Pins read high until driven.
+ */
+extern void pynq_sim_set_xshut(int dev, io_t pin);
+
+/** @brief Set the target distance a VL53L0X model reports, in mm. */
+extern void pynq_sim_set_distance(int dev, uint16_t mm);
+
+/**
+ * @brief Set the light a TCS3472 model sees.
+ * Rates are counts per 2.4 ms integration step at gain x1.
+ */
+extern void pynq_sim_set_colour(int dev, uint16_t r, uint16_t g, uint16_t b, uint16_t c);
+
+/** @brief Change the bus clock of an I2C bus, in Hz. */
+extern void pynq_sim_set_iic_speed(iic_index_t iic, uint32_t hz);
+
+/** @brief Queue bytes from the host side of a UART. */
+extern void pynq_sim_uart_inject(int uart, const uint8_t *data, uint32_t len);
+
+/** @brief Total steps executed by each wheel since stepper_init. */
+extern void pynq_sim_stepper_position(int32_t *left, int32_t *right);
+
+/** @brief Print bus, UART and cycle latency statistics. */
+extern void pynq_sim_report(FILE *f);
+
+#endif /* PYNQ_SIM_H */
@@ -0,0 +1,20 @@
+/* Host-side stand-in for libpynq's stepper.h. */
+#ifndef STEPPER_H
+#define STEPPER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern void stepper_init(void);
+extern void stepper_destroy(void);
+extern void stepper_reset(void);
+extern void stepper_enable(void);
+extern void stepper_disable(void);
+/* Speeds are step periods in controller ticks; lower is faster. */
+extern void stepper_set_speed(uint16_t left_speed, uint16_t right_speed);
+extern void stepper_steps(int16_t left, int16_t right);
+extern bool stepper_steps_done(void);
+/* Steps still to be executed by the current move. */
+extern void stepper_get_steps(int16_t *left, int16_t *right);
+
+#endif /* STEPPER_H */
@@ -0,0 +1,19 @@
+/* Host-side stand-in for libpynq's switchbox.h (subset). */
+#ifndef SWITCHBOX_H
+#define SWITCHBOX_H
+
+#include <stdint.h>
+#include <pinmap.h>
+
+enum {
+  SWB_GPIO = 0x00,
+  SWB_UART0_TX = 0x02, SWB_UART0_RX = 0x03,
+  SWB_IIC0_SDA = 0x0A, SWB_IIC0_SCL = 0x0B,
+  SWB_IIC1_SDA = 0x0C, SWB_IIC1_SCL = 0x0D,
+};
+
+extern void switchbox_init(void);
+extern void switchbox_destroy(void);
+extern void switchbox_set_pin(const io_t pin_number, const uint8_t pin_type);
+
+#endif /* SWITCHBOX_H */
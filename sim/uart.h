@@ -0,0 +1,18 @@
+/* Host-side stand-in for libpynq's uart.h (subset). */
+#ifndef UART_H
+#define UART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum { UART0 = 0, UART1 = 1, NUM_UARTS = 2 } uart_index_t;
+
+extern void uart_init(const int uart);
+extern void uart_destroy(const int uart);
+extern void uart_reset_fifos(const int uart);
+extern void uart_send(const int uart, const uint8_t data);
+extern uint8_t uart_recv(const int uart);
+extern bool uart_has_data(const int uart);
+extern bool uart_has_space(const int uart);
+
+#endif /* UART_H */
@@ -0,0 +1,7 @@
+/* Host-side stand-in for libpynq's util.h (subset). */
+#ifndef UTIL_H
+#define UTIL_H
+
+extern void sleep_msec(int msec);
+
+#endif /* UTIL_H */
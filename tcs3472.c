@@ -7,16 +7,61 @@
 
 #include <libpynq.h>
 #include <tcs3472.h>
+#include <iic_profile.h>
 
 #include <unistd.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
+
+#define TCS3472_AVALID_RETRY_US 2400 //One ATIME step
+
+static uint64_t time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/**
+ * ATIME in use: the one set, or 60ms before `tcs_set_integration`
+ */
+static uint8_t atime_of(const tcs3472 *sensor)
+{
+  return sensor->integration_set ? sensor->integration_time : (uint8_t)tcs3472_integration_from_ms(60);
+}
+
+/**
+ * Length of one RGBC integration in microseconds
+ */
+static uint32_t integration_us(tcs3472 *sensor)
+{
+  return (256 - (uint32_t)atime_of(sensor)) * 2400;
+}
+
+static const uint8_t gain_factor[4] = {1, 4, 16, 60};
+
+/**
+ * Integration length in 2.4ms steps
+ */
+static uint32_t integration_cycles(const tcs3472 *sensor)
+{
+  return 256 - (uint32_t)atime_of(sensor);
+}
+
+/**
+ * Largest count a channel can reach for an integration of `cycles` steps
+ */
+static uint32_t full_scale(uint32_t cycles)
+{
+  return cycles >= 64 ? 65535 : 1024 * cycles;
+}
 
 int write_byte(iic_index_t iic, uint8_t reg, uint8_t data)
 {
-  return iic_write_register(iic, TCS3472_I2C_ADDR, reg, &data, 1);
+  return IIC_WRITE(iic, TCS3472_I2C_ADDR, reg, &data, 1);
 }
 
 int tcs_ping(iic_index_t iic, uint8_t *p_id)
@@ -25,7 +70,7 @@ int tcs_ping(iic_index_t iic, uint8_t *p_id)
   if(p_id == NULL)
     p_id = &temp;
 
-  int error = iic_read_register(iic, TCS3472_I2C_ADDR, tcs3472_repeat_byte(TCS3472_ID_REG), p_id, 1);
+  int error = IIC_READ(iic, TCS3472_I2C_ADDR, tcs3472_repeat_byte(TCS3472_ID_REG), p_id, 1);
   if(error)
     return TCS3472_ERROR;
   
@@ -39,8 +84,10 @@ int tcs_ping(iic_index_t iic, uint8_t *p_id)
 int tcs_set_integration(tcs3472 *sensor, uint8_t atime)
 {
   sensor->integration_time = atime;
+  sensor->integration_set = 1;
   if(sensor->enabled)
   {
+    sensor->next_sample_us = time_us() + integration_us(sensor);
     return write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ATIME_REG), sensor->integration_time);
   }
   return TCS3472_SUCCES;
@@ -59,6 +106,184 @@ int tcs_set_gain(tcs3472 *sensor, tcs3472_gain gain)
   return TCS3472_SUCCES;
 }
 
+/**
+ * Turn auto exposure on or off
+ */
+int tcs_set_auto_exposure(tcs3472 *sensor, uint8_t max_cycles)
+{
+  sensor->ae_max_cycles = max_cycles;
+  return TCS3472_SUCCES;
+}
+
+void tcs_normalise(const tcs3472 *sensor, const tcsReading *raw, tcsReading *out)
+{
+  uint32_t div = gain_factor[sensor->gain & TCS3472_CONTROL_GAIN] * integration_cycles(sensor);
+  const uint16_t *in[4] = {&raw->red, &raw->green, &raw->blue, &raw->clear};
+  uint16_t v[4];
+  for(int ch = 0; ch < 4; ch++)
+  {
+    uint32_t n = ((uint32_t)*in[ch] * TCS3472_NORM_SCALE + div / 2) / div;
+    v[ch] = n > 0xFFFF ? 0xFFFF : (uint16_t)n;
+  }
+  out->red = v[0]; out->green = v[1]; out->blue = v[2]; out->clear = v[3];
+}
+
+/**
+ * Pick the exposure for the next samples from a raw reading.
+ *
+ * The light level is estimated as CLEAR counts per 2.4ms step at x1. The
+ * shortest integration, at the highest gain that stays under
+ * TCS3472_AE_HIGH_PCT of full scale, that still collects
+ * TCS3472_AE_MIN_CLEAR counts wins; in the dark the longest integration at
+ * x60 is used. A usable reading keeps its exposure unless a shorter
+ * integration will do. A clipped reading only says the light is too bright, so the
+ * exposure is cut by about four (one gain step, or a quarter of the
+ * integration at x1) and the next sample tells more.
+ */
+static int auto_exposure(tcs3472 *sensor, const tcsReading *raw)
+{
+  uint32_t cycles = integration_cycles(sensor);
+  tcs3472_gain gain = sensor->gain;
+  uint32_t n = sensor->ae_max_cycles, g = x60;
+
+  if((uint32_t)raw->clear * 100 >= full_scale(cycles) * TCS3472_AE_SAT_PCT)
+  {
+    n = cycles;
+    if(gain > x1) g = gain - 1;
+    else { g = x1; n = cycles / 4 ? cycles / 4 : 1; }
+  }
+  else
+  {
+    float rate = (float)raw->clear / (gain_factor[gain] * cycles);
+    int found = 0;
+    for(uint32_t c = 1; c <= sensor->ae_max_cycles && !found; c++)
+    {
+      for(int k = x60; k >= x1; k--)
+      {
+        float clear = rate * gain_factor[k] * c;
+        if(clear * 100 > (float)full_scale(c) * TCS3472_AE_HIGH_PCT) continue;
+        if(clear >= TCS3472_AE_MIN_CLEAR) { n = c; g = (uint32_t)k; found = 1; }
+        break;
+      }
+    }
+  }
+  //a usable reading only gives way to a shorter integration
+  int usable = raw->clear >= TCS3472_AE_MIN_CLEAR
+            && (uint32_t)raw->clear * 100 < full_scale(cycles) * TCS3472_AE_SAT_PCT;
+  if((n == cycles && g == (uint32_t)gain) || (usable && n >= cycles))
+    return TCS3472_SUCCES;
+
+  //the cycle in progress mixes old and new settings: skip it
+  uint64_t old_us = integration_us(sensor);
+  int error = tcs_set_integration(sensor, (uint8_t)(256 - n));
+  error += tcs_set_gain(sensor, (tcs3472_gain)g);
+  sensor->next_sample_us += old_us;
+  return error != TCS3472_SUCCES;
+}
+
+/**
+ * Arm the clear-channel interrupt
+ *
+ * Thresholds and persistence are written before AIEN, and a stale AINT is
+ * cleared last, so the first interrupt is judged on the new band only.
+ */
+int tcs_set_interrupt(tcs3472 *sensor, uint16_t low, uint16_t high, uint8_t persistence)
+{
+  static const uint8_t pers_cycles[16] = {0, 1, 2, 3, 5, 10, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60};
+  if(!sensor->enabled)
+    return TCS3472_ERROR;
+
+  uint8_t pers = 1; //0 would interrupt on every cycle
+  while(pers < 15 && pers_cycles[pers] < persistence)
+    pers++;
+
+  uint8_t thresholds[4] = {(uint8_t)low, (uint8_t)(low >> 8), (uint8_t)high, (uint8_t)(high >> 8)};
+  int error = IIC_WRITE(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_multi_byte(TCS3472_AILTL_REG), thresholds, 4);
+  error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_PERS_REG), pers);
+  if(!sensor->interrupt)
+  {
+    error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ENABLE_REG), TCS3472_ENABLE_PON | TCS3472_ENABLE_AEN | TCS3472_ENABLE_AIEN);
+    sensor->interrupt = !error;
+  }
+  error += tcs_clear_interrupt(sensor);
+  return (error != TCS3472_SUCCES);
+}
+
+/**
+ * Turn the clear-channel interrupt off
+ */
+int tcs_disable_interrupt(tcs3472 *sensor)
+{
+  if(!sensor->enabled || !sensor->interrupt)
+    return TCS3472_SUCCES;
+  int error = write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ENABLE_REG), TCS3472_ENABLE_PON | TCS3472_ENABLE_AEN);
+  error += tcs_clear_interrupt(sensor);
+  sensor->interrupt = 0;
+  return (error != TCS3472_SUCCES);
+}
+
+/**
+ * Read whether the clear-channel interrupt is pending
+ */
+int tcs_get_interrupt(tcs3472 *sensor)
+{
+  uint8_t state;
+  int error = IIC_READ(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_repeat_byte(TCS3472_STATE_REG), &state, 1);
+  if(error)
+    return TCS3472_ERROR;
+  return (state & TCS3472_STATE_AINT) ? TCS3472_INT_RAISED : TCS3472_INT_IDLE;
+}
+
+/**
+ * Clear a pending clear-channel interrupt: a special-function command
+ * byte with no data
+ */
+int tcs_clear_interrupt(tcs3472 *sensor)
+{
+  return IIC_WRITE(sensor->iic_index, TCS3472_I2C_ADDR, TCS3472_CLEAR_INT_CMD, NULL, 0) != 0;
+}
+
+/**
+ * Turn watch mode on or off
+ */
+int tcs_watch(tcs3472 *sensor, uint8_t band_pct, uint8_t persistence)
+{
+  sensor->watch_band_pct = band_pct;
+  sensor->watch_persistence = persistence;
+  sensor->watch_armed = 0;
+  if(!band_pct)
+    return tcs_disable_interrupt(sensor);
+  return TCS3472_SUCCES;
+}
+
+/**
+ * Set the interrupt band around the CLEAR of the sample just returned.
+ *
+ * The thresholds are compared with raw counts, so a normalised sample is
+ * converted back with the settings auto exposure has picked for the
+ * following cycles.
+ */
+static int watch_arm(tcs3472 *sensor, const tcsReading *sample)
+{
+  uint32_t raw = sample->clear;
+  if(sensor->ae_max_cycles)
+    raw = raw * gain_factor[sensor->gain & TCS3472_CONTROL_GAIN] * integration_cycles(sensor) / TCS3472_NORM_SCALE;
+
+  uint32_t band = raw * sensor->watch_band_pct / 100;
+  if(band < TCS3472_WATCH_MIN_BAND)
+    band = TCS3472_WATCH_MIN_BAND;
+  uint32_t low = raw > band ? raw - band : 0;
+  uint32_t high = raw + band > 0xFFFF ? 0xFFFF : raw + band;
+
+  sensor->watch_armed = 0;
+  if(tcs_set_interrupt(sensor, (uint16_t)low, (uint16_t)high, sensor->watch_persistence))
+    return TCS3472_ERROR;
+  sensor->watch_armed = 1;
+  sensor->watch_last = *sample;
+  sensor->watch_full_us = time_us() + TCS3472_WATCH_MAX_AGE_US;
+  return TCS3472_SUCCES;
+}
+
 /**
  * Initialize the TCS3472 Sensor.
  */
@@ -70,11 +295,15 @@ int tcs_init(iic_index_t iic, tcs3472 *sensor)
   sleep_msec(10); //Allow sensor to recover
   error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ENABLE_REG), TCS3472_ENABLE_PON | TCS3472_ENABLE_AEN);
   //RGBC-INTEGRATION
-  error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ATIME_REG), sensor->integration_time > 0 ? sensor->integration_time : tcs3472_integration_from_ms(60));
+  error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_ATIME_REG), atime_of(sensor));
   //GAIN
   error += write_byte(sensor->iic_index, tcs3472_repeat_byte(TCS3472_CONTROL_REG), (TCS3472_CONTROL_GAIN & sensor->gain));
 
   sensor->enabled = 1;
+  sensor->interrupt = 0;
+  sensor->watch_armed = 0;
+  //First cycle ends after the 2.4ms init step plus one integration
+  sensor->next_sample_us = time_us() + TCS3472_AVALID_RETRY_US + integration_us(sensor);
 
   return (error != TCS3472_SUCCES);
 }
@@ -86,7 +315,7 @@ int tcs_get_ready(tcs3472 *sensor)
 {
   //measurement ready?
   uint8_t state;
-  int error = iic_read_register(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_repeat_byte(TCS3472_STATE_REG), &state, 1); 
+  int error = IIC_READ(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_repeat_byte(TCS3472_STATE_REG), &state, 1); 
   if(error)
     return TCS3472_ERROR;
   return (state & 1);
@@ -98,24 +327,105 @@ int tcs_get_ready(tcs3472 *sensor)
 int read_colour_reg(tcs3472 *sensor, uint8_t reg, uint16_t *colour)
 {
   uint8_t temp[2];
-  int error = iic_read_register(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_multi_byte(reg), temp, 2);
+  int error = IIC_READ(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_multi_byte(reg), temp, 2);
   *colour = (((uint16_t)temp[1]) << 8) | ((uint16_t)temp[0]);
 
   return error;
 }
 
+/**
+ * Decode the little-endian CLEAR, RED, GREEN, BLUE block
+ */
+static void decode_rgbc(const uint8_t *raw, tcsReading *rgb)
+{
+  rgb->clear = (((uint16_t)raw[1]) << 8) | ((uint16_t)raw[0]);
+  rgb->red   = (((uint16_t)raw[3]) << 8) | ((uint16_t)raw[2]);
+  rgb->green = (((uint16_t)raw[5]) << 8) | ((uint16_t)raw[4]);
+  rgb->blue  = (((uint16_t)raw[7]) << 8) | ((uint16_t)raw[6]);
+}
+
 /**
  * Read the current valid data in RGB + Clear.
+ *
+ * All eight data bytes are fetched in one auto-increment transaction
+ * starting at CDATAL. The sensor only updates the data registers at the end
+ * of an integration cycle and reading CDATAL latches the remaining bytes,
+ * so the four channels always come from the same cycle.
  */
 int tcs_get_reading(tcs3472 *sensor, tcsReading *rgb)
 {
-  int error;
+  uint8_t raw[TCS3472_RGBC_BYTES];
+  int error = IIC_READ(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_multi_byte(TCS3472_CLEAR_REG), raw, TCS3472_RGBC_BYTES);
+  if(error)
+    return TCS3472_ERROR;
+
+  decode_rgbc(raw, rgb);
+  return TCS3472_SUCCES;
+}
 
-  //Reading colour registers
-  error = read_colour_reg(sensor, TCS3472_RED_REG, &rgb->red);
-  error += read_colour_reg(sensor, TCS3472_GREEN_REG, &rgb->green);
-  error += read_colour_reg(sensor, TCS3472_BLUE_REG, &rgb->blue);
-  error += read_colour_reg(sensor, TCS3472_CLEAR_REG, &rgb->clear);
+/**
+ * Whether a new integration may have completed since the last sample.
+ */
+int tcs_sample_due(tcs3472 *sensor)
+{
+  return time_us() >= sensor->next_sample_us;
+}
 
-  return (error != TCS3472_SUCCES);
+/**
+ * Non-blocking read of a fresh sample.
+ *
+ * AVALID stays set once the first integration has finished, so freshness is
+ * tracked here: after a sample the next one is only taken an integration
+ * time later, by which point at least one new cycle has ended.
+ *
+ * In watch mode the cycles that ended meanwhile kept CLEAR inside the band
+ * unless AINT is set, so one status byte decides whether the last sample
+ * still stands or the data has to be fetched.
+ */
+int tcs_poll_reading(tcs3472 *sensor, tcsSample *sample)
+{
+  uint64_t now = time_us();
+  if(now < sensor->next_sample_us)
+    return TCS3472_PENDING;
+
+  if(sensor->watch_band_pct && sensor->watch_armed && now < sensor->watch_full_us)
+  {
+    int interrupt = tcs_get_interrupt(sensor);
+    if(interrupt == TCS3472_ERROR)
+      return TCS3472_ERROR;
+    if(interrupt == TCS3472_INT_IDLE)
+    {
+      sample->rgb = sensor->watch_last;
+      sample->t_us = now;
+      sensor->next_sample_us = now + integration_us(sensor);
+      return TCS3472_READY;
+    }
+  }
+
+  //STATUS (0x13) is directly in front of the data registers
+  uint8_t raw[1 + TCS3472_RGBC_BYTES];
+  int error = IIC_READ(sensor->iic_index, TCS3472_I2C_ADDR, tcs3472_multi_byte(TCS3472_STATE_REG), raw, sizeof(raw));
+  if(error)
+    return TCS3472_ERROR;
+
+  if(!(raw[0] & TCS3472_STATE_AVALID))
+  {
+    sensor->next_sample_us = now + TCS3472_AVALID_RETRY_US;
+    return TCS3472_PENDING;
+  }
+
+  decode_rgbc(&raw[1], &sample->rgb);
+  tcsReading raw_rgb = sample->rgb;
+  sample->t_us = now;
+  sensor->next_sample_us = now + integration_us(sensor);
+  if(sensor->ae_max_cycles)
+  {
+    //normalise with the settings this sample was taken with
+    tcs_normalise(sensor, &sample->rgb, &sample->rgb);
+    if(auto_exposure(sensor, &raw_rgb))
+      return TCS3472_ERROR;
+  }
+  if(sensor->watch_band_pct && watch_arm(sensor, &sample->rgb))
+    return TCS3472_ERROR;
+  return TCS3472_READY;
 }
@@ -37,28 +37,49 @@
 #define TCS3472_ATIME_REG 0x01
 #define TCS3472_WTIME_REG 0x03 
 #define TCS3472_CONTROL_REG 0x0F //single -> gain
+#define TCS3472_AILTL_REG 0x04 //clear interrupt low threshold, AILTL..AIHTH 0x04-0x07
+#define TCS3472_PERS_REG 0x0C //interrupt persistence filter
 
 //Data
 #define TCS3472_CLEAR_REG 0x14
 #define TCS3472_RED_REG 0x16
 #define TCS3472_GREEN_REG 0x18
 #define TCS3472_BLUE_REG 0x1A
+#define TCS3472_RGBC_BYTES 8 //CLEAR..BLUE, 0x14-0x1B
 
 #define TCS3472_ID_TCS34725 0x44
 #define TCS3472_ID_TCS34727 0x4D
 #define TCS3472_INTEG_MIN 1
 #define TCS3472_INTEG_MAX 256
 
+#define TCS3472_STATE_AVALID 0x01 //RGBC integration completed
+#define TCS3472_STATE_AINT 0x10 //CLEAR left the threshold band
+
+//Auto exposure: keep CLEAR between these, as a share of full scale / in counts
+#define TCS3472_AE_HIGH_PCT 60    //aim below this, so changes in light fit
+#define TCS3472_AE_SAT_PCT 90     //at or above this the reading is clipped
+#define TCS3472_AE_MIN_CLEAR 1000 //fewer counts are too coarse to classify
+#define TCS3472_NORM_SCALE 100    //normalised = counts at x4 gain and 60 ms
+
+//Watch mode: full sample at least this often, to catch colour changes at the same brightness
+#define TCS3472_WATCH_MAX_AGE_US 500000
+#define TCS3472_WATCH_MIN_BAND 16 //counts either side, so a dark floor does not fire on noise
+
 #define TCS3472_ENABLE_PON 0x01 //Clock
 #define TCS3472_ENABLE_AEN 0x02 //ADC
+#define TCS3472_ENABLE_AIEN 0x10 //Clear-channel interrupt
 #define TCS3472_CONTROL_GAIN 0x03
 
 #define TCS3472_SUCCES 0
 #define TCS3472_ERROR 1
 #define TCS3472_READY 2
+#define TCS3472_PENDING 3 //No new integration since the last sample
+#define TCS3472_INT_IDLE 4 //tcs_get_interrupt: CLEAR stayed within the thresholds
+#define TCS3472_INT_RAISED 5 //tcs_get_interrupt: AINT is set
 
 #define tcs3472_repeat_byte(reg) reg | 0x80
 #define tcs3472_multi_byte(reg) reg | 0xA0
+#define TCS3472_CLEAR_INT_CMD 0xE6 //special function: clear AINT
 #define tcs3472_integration_from_ms(ms) 256 - (ms / 2.4)
 #define CLAMP_255(a) (((a)>(255))?(255):(a))
 
@@ -72,17 +93,6 @@
  */
 typedef enum _tcs3472_gain_ {x1, x4, x16, x60} tcs3472_gain;
 
-/**
- * @brief Internal type, do not modify directly. 
- */
-typedef struct _tcs3472_sensor_ {
-    int enabled;
-    iic_index_t iic_index;
-    uint8_t integration_time; //Longer integration time lowers sensitivity but increases accuracy
-    tcs3472_gain gain;
-} tcs3472;
-#define TCS3472_EMPTY {0, IIC0, 0, x1}
-
 /**
  * @struct tcsReading
  * @brief Holds the result of a TCS3472 sensor reading.
@@ -99,6 +109,37 @@ typedef struct _tcs3472_reading_ {
     uint16_t clear;
 } tcsReading;
 
+/**
+ * @brief Internal type, do not modify directly. 
+ */
+typedef struct _tcs3472_sensor_ {
+    int enabled;
+    iic_index_t iic_index;
+    uint8_t integration_time; //Longer integration time lowers sensitivity but increases accuracy
+    uint8_t integration_set; //integration_time was set, otherwise 60ms is used
+    tcs3472_gain gain;
+    uint64_t next_sample_us; //Earliest time a new integration can be complete
+    uint8_t ae_max_cycles; //Auto exposure: longest integration in 2.4ms steps, 0 = off
+    uint8_t interrupt; //AIEN set on the sensor
+    uint8_t watch_band_pct; //Watch mode: band around the last CLEAR, 0 = off
+    uint8_t watch_persistence;
+    uint8_t watch_armed; //Thresholds set around watch_last
+    uint64_t watch_full_us; //Next forced full sample
+    tcsReading watch_last; //Last full sample, as returned
+} tcs3472;
+#define TCS3472_EMPTY {0, IIC0, 0, 0, x1, 0, 0, 0, 0, 0, 0, 0, {0, 0, 0, 0}}
+
+/**
+ * @struct tcsSample
+ * @brief A reading plus the time it was taken.
+ * @param rgb colour channels
+ * @param t_us CLOCK_MONOTONIC timestamp in microseconds
+ */
+typedef struct _tcs3472_sample_ {
+    tcsReading rgb;
+    uint64_t t_us;
+} tcsSample;
+
 /**
  * @brief Connection test for a TCS3472 Sensor
  * @param iic IIC Index
@@ -111,7 +152,7 @@ extern int tcs_ping(iic_index_t iic, uint8_t *p_id);
  * @brief Sets the integration time of the tcs3472. 
  * Longer integration time lowers sensitivity but increases accuracy
  * @param sensor Handle to the sensor.
- * @param atime Integration time in 2.4ms increments. 0xFF::2.4ms 0x00::700ms
+ * @param atime Integration time in 2.4ms increments. 0xFF::2.4ms 0x00::614ms
  * @return 0 if successful, 1 on error
  * @note Will update the setting on the actual sensor if its initialised.
  * @note else the setting is stored for `tcs_init`
@@ -128,6 +169,80 @@ extern int tcs_set_integration(tcs3472 *sensor, uint8_t atime);
  */
 extern int tcs_set_gain(tcs3472 *sensor, tcs3472_gain gain);
 
+/**
+ * @brief Let the driver pick gain and integration time per sample.
+ * After each sample taken by `tcs_poll_reading` the shortest integration
+ * (and the gain) that keeps CLEAR between TCS3472_AE_MIN_CLEAR counts and
+ * TCS3472_AE_HIGH_PCT of full scale is chosen; a clipped sample cuts the
+ * exposure fourfold. Samples are then returned normalised (`tcs_normalise`).
+ * @param sensor Handle to the sensor.
+ * @param max_cycles longest integration allowed, in 2.4ms steps; 0 turns
+ * auto exposure off and leaves the current settings.
+ * @return 0 if successful, 1 on error
+ */
+extern int tcs_set_auto_exposure(tcs3472 *sensor, uint8_t max_cycles);
+
+/**
+ * @brief Scale a reading taken at the sensor's current gain and
+ * integration time to what it would be at x4 gain and 60 ms, so readings
+ * compare across settings. Saturates at 65535.
+ * @param sensor Handle to the sensor.
+ * @param raw reading as taken.
+ * @param out normalised reading, may be `raw`.
+ */
+extern void tcs_normalise(const tcs3472 *sensor, const tcsReading *raw, tcsReading *out);
+
+/**
+ * @brief Arm the clear-channel interrupt.
+ * STATUS.AINT is set once CLEAR has been below `low` or above `high` for
+ * `persistence` integration cycles in a row, and stays set until
+ * `tcs_clear_interrupt`. The INT pin is not needed: poll the status.
+ * @param sensor Handle to the (initialised) sensor.
+ * @param low threshold in raw CLEAR counts.
+ * @param high threshold in raw CLEAR counts.
+ * @param persistence cycles in a row, rounded up to 1, 2, 3, 5, 10, 15 .. 60
+ * @return 0 if successful, 1 on error or if the sensor is not initialised
+ * @note A pending interrupt is cleared.
+ */
+extern int tcs_set_interrupt(tcs3472 *sensor, uint16_t low, uint16_t high, uint8_t persistence);
+
+/**
+ * @brief Turn the clear-channel interrupt off.
+ * @param sensor Handle to the sensor.
+ * @return 0 if successful, 1 on error
+ */
+extern int tcs_disable_interrupt(tcs3472 *sensor);
+
+/**
+ * @brief Read whether the clear-channel interrupt is pending.
+ * Costs one status-byte read.
+ * @param sensor Handle to the sensor.
+ * @returns TCS3472_INT_RAISED if it is, TCS3472_INT_IDLE if not,
+ * TCS3472_ERROR on bus error
+ */
+extern int tcs_get_interrupt(tcs3472 *sensor);
+
+/**
+ * @brief Clear a pending clear-channel interrupt.
+ * @param sensor Handle to the sensor.
+ * @return 0 if successful, 1 on error
+ */
+extern int tcs_clear_interrupt(tcs3472 *sensor);
+
+/**
+ * @brief Only fetch the colour data when the brightness changes.
+ * `tcs_poll_reading` then keeps the interrupt armed `band_pct` percent
+ * either side of the last CLEAR and, while it has not fired, reads only
+ * STATUS and returns the last sample again with a new timestamp. A full
+ * sample is taken when it fires, and at least every
+ * TCS3472_WATCH_MAX_AGE_US.
+ * @param sensor Handle to the sensor.
+ * @param band_pct width of the band, 0 turns watch mode (and the interrupt) off.
+ * @param persistence see `tcs_set_interrupt`
+ * @return 0 if successful, 1 on error
+ */
+extern int tcs_watch(tcs3472 *sensor, uint8_t band_pct, uint8_t persistence);
+
 /**
  * @brief Initialize the TCS3472 Sensor.
  * @param sensor Handle to the sensor.
@@ -145,11 +260,36 @@ extern int tcs_get_ready(tcs3472 *sensor);
 
 /**
  * @brief Read the current valid data in RGB + Clear.
+ * All four channels are read in a single burst and belong to the same
+ * integration cycle.
  * @param sensor Handle to the sensor.
  * @param rgb pointer to store result of reading.
  * @returns 0 if successful, 1 on error
  */
 extern int tcs_get_reading(tcs3472 *sensor, tcsReading *rgb);
 
+/**
+ * @brief Whether a new integration may have completed since the last sample.
+ * Costs no bus traffic, so callers can skip selecting the mux channel.
+ * @param sensor Handle to the sensor.
+ * @returns 1 if `tcs_poll_reading` is worth calling, 0 otherwise
+ */
+extern int tcs_sample_due(tcs3472 *sensor);
+
+/**
+ * @brief Non-blocking read of a fresh sample.
+ * Returns immediately without touching the bus until one integration time
+ * has passed since the previous sample. Otherwise STATUS and the RGBC data
+ * are fetched in one burst; a sample is only taken when AVALID is set.
+ * In watch mode (`tcs_watch`) only STATUS is read until the interrupt fires.
+ * @param sensor Handle to the sensor.
+ * @param sample pointer to store a fresh timestamped reading.
+ * @returns TCS3472_READY with a new sample, TCS3472_PENDING if there is no
+ * new data, TCS3472_ERROR on bus error
+ * @note With auto exposure on the sample is normalised and the exposure
+ * for the following samples may change.
+ */
+extern int tcs_poll_reading(tcs3472 *sensor, tcsSample *sample);
+
 
 #endif // _TCSLIB_H_
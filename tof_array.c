@@ -0,0 +1,106 @@
+#include "tof_array.h"
+#include <libpynq.h>
+
+#include <string.h>
+#include <time.h>
+
+#define TOF_DEFAULT_ADDR 0x29
+#define TOF_ADDR_MIN     0x08   /* 7-bit addresses outside the reserved ones */
+#define TOF_ADDR_MAX     0x77
+#define TOF_BOOT_MS      2      /* firmware boot after XSHUT release, 1.2 ms max */
+#define TOF_RESET_MS     10
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+int tof_array_init(tof_array *arr, iic_index_t iic, const io_t *xshut,
+                   const uint8_t *addr, uint8_t count, vl53xProfile profile)
+{
+    if (!arr || !xshut || !addr || count == 0 || count > TOF_ARRAY_MAX) return 1;
+    /* checked before any XSHUT moves: two sensors on one address, or one
+     * left at 0x29 where the next sensor boots, cannot be told apart */
+    for (uint8_t i = 0; i < count; i++) {
+        if (addr[i] < TOF_ADDR_MIN || addr[i] > TOF_ADDR_MAX || addr[i] == TOF_DEFAULT_ADDR) return 1;
+        for (uint8_t j = 0; j < i; j++)
+            if (addr[j] == addr[i]) return 1;
+    }
+    memset(arr, 0, sizeof(*arr));
+
+    /* hold every sensor in reset so only one answers at 0x29 */
+    for (uint8_t i = 0; i < count; i++) {
+        arr->xshut[i] = xshut[i];
+        arr->mm[i]    = TOF_ARRAY_INVALID_MM;
+        gpio_set_direction(xshut[i], GPIO_DIR_OUTPUT);
+        gpio_set_level(xshut[i], GPIO_LEVEL_LOW);
+    }
+    sleep_msec(TOF_RESET_MS);
+
+    for (uint8_t i = 0; i < count; i++) {
+        gpio_set_level(xshut[i], GPIO_LEVEL_HIGH);
+        sleep_msec(TOF_BOOT_MS);
+        if (tofPing(iic, TOF_DEFAULT_ADDR) || tofSetAddress(iic, TOF_DEFAULT_ADDR, addr[i]))
+            return 1;
+        if (tofPing(iic, addr[i]) || tofInit(&arr->sensor[i], iic, addr[i], 0)) return 1;
+        if (profile != VL53X_PROFILE_DEFAULT && tofSetProfile(&arr->sensor[i], profile)) return 1;
+        arr->count = i + 1;
+    }
+    return 0;
+}
+
+int tof_array_start(tof_array *arr, uint32_t period_ms)
+{
+    int err = 0;
+    for (uint8_t i = 0; i < arr->count; i++)
+        err |= tofStartContinuous(&arr->sensor[i], period_ms);
+    return err;
+}
+
+int tof_array_stop(tof_array *arr)
+{
+    int err = 0;
+    for (uint8_t i = 0; i < arr->count; i++)
+        err |= tofStopContinuous(&arr->sensor[i]);
+    return err;
+}
+
+int tof_array_read(tof_array *arr, uint16_t *mm, uint64_t deadline_us)
+{
+    int result = VL53X_OK;
+    /* all sensors are already ranging: waiting on them in turn overlaps */
+    for (uint8_t i = 0; i < arr->count; i++) {
+        int err = tofReadDistanceUntil(&arr->sensor[i], deadline_us, &arr->mm[i]);
+        if (err == VL53X_OK) {
+            arr->t_us[i] = time_us();
+        } else {
+            arr->mm[i] = TOF_ARRAY_INVALID_MM;
+            if (result == VL53X_OK) result = err;
+        }
+        if (mm) mm[i] = arr->mm[i];
+    }
+    return result;
+}
+
+uint32_t tof_array_poll(tof_array *arr)
+{
+    uint32_t fresh = 0;
+    for (uint8_t i = 0; i < arr->count; i++) {
+        if (tofPollContinuous(&arr->sensor[i], &arr->mm[i]) == VL53X_OK) {
+            arr->t_us[i] = time_us();
+            fresh |= 1u << i;
+        }
+    }
+    return fresh;
+}
+
+int tof_array_destroy(tof_array *arr)
+{
+    if (!arr) return 1;
+    for (uint8_t i = 0; i < arr->count; i++)
+        gpio_set_level(arr->xshut[i], GPIO_LEVEL_LOW);
+    arr->count = 0;
+    return 0;
+}
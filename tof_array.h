@@ -0,0 +1,62 @@
+#ifndef TOF_ARRAY_H
+#define TOF_ARRAY_H
+
+#include <stdint.h>
+#include <libpynq.h>
+#include "vl53l0x.h"
+
+/*
+ * Several VL53L0X on one bus, each moved to its own address at startup.
+ *
+ * All sensors power up at 0x29, so each one's XSHUT pin is wired to a GPIO:
+ * the array holds every sensor in reset, then releases them one at a time
+ * and reassigns the address of the one that just booted. Afterwards all
+ * sensors range continuously and in parallel, and are read without any mux
+ * switching; put the ring on the root bus (or on a mux channel that stays
+ * enabled).
+ */
+
+#define TOF_ARRAY_MAX        4
+#define TOF_ARRAY_INVALID_MM 0xFFFF   /* no reading from this sensor */
+
+/* Handle for a ring of VL53L0X sensors */
+typedef struct tof_array {
+    uint8_t  count;
+    vl53x    sensor[TOF_ARRAY_MAX];
+    io_t     xshut[TOF_ARRAY_MAX];
+    uint16_t mm[TOF_ARRAY_MAX];     /* latest distance per sensor */
+    uint64_t t_us[TOF_ARRAY_MAX];   /* when it was read, 0 = never */
+} tof_array;
+
+/*
+ * Bring up `count` sensors: sensor i has its XSHUT on xshut[i] and is moved
+ * to addr[i]. Every sensor is initialised with `profile`.
+ * The addresses must differ from each other and from 0x29, where every
+ * sensor boots; they are checked before any XSHUT line is touched.
+ * Returns 0 on success, 1 on error (bad addresses, a sensor did not answer).
+ */
+int tof_array_init(tof_array *arr, iic_index_t iic, const io_t *xshut,
+                   const uint8_t *addr, uint8_t count, vl53xProfile profile);
+
+/* Start continuous ranging on every sensor, period as in tofStartContinuous */
+int tof_array_start(tof_array *arr, uint32_t period_ms);
+int tof_array_stop (tof_array *arr);
+
+/*
+ * Collect one fresh distance per sensor into mm[0..count-1]. The sensors
+ * range concurrently, so this takes about one measurement period in total.
+ * Sensors that miss deadline_us (CLOCK_MONOTONIC us) get
+ * TOF_ARRAY_INVALID_MM and VL53X_TIMEOUT / VL53X_ERROR is returned.
+ */
+int tof_array_read(tof_array *arr, uint16_t *mm, uint64_t deadline_us);
+
+/*
+ * Non-blocking: pick up whatever new measurements are ready into arr->mm.
+ * Returns a bitmask of the sensors that produced a new reading.
+ */
+uint32_t tof_array_poll(tof_array *arr);
+
+/* Put every sensor back in reset */
+int tof_array_destroy(tof_array *arr);
+
+#endif /* TOF_ARRAY_H */
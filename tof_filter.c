@@ -0,0 +1,153 @@
+#include "tof_filter.h"
+#include "vl53l0x.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TOF_FILTER_RATE_SD0 500.0f   /* mm/s, range rate unknown at start */
+
+void tof_filter_init(tof_filter *f, const tof_filter_cfg *cfg)
+{
+    memset(f, 0, sizeof(*f));
+    f->cfg = *cfg;
+    if (f->cfg.window < 1) f->cfg.window = 1;
+    if (f->cfg.window > TOF_FILTER_WINDOW_MAX) f->cfg.window = TOF_FILTER_WINDOW_MAX;
+    f->outlier_mm = -1;
+}
+
+void tof_filter_reset(tof_filter *f)
+{
+    tof_filter_cfg cfg = f->cfg;
+    uint32_t accepted = f->n_accepted, rejected = f->n_rejected;
+    tof_filter_init(f, &cfg);
+    f->n_accepted = accepted;
+    f->n_rejected = rejected;
+}
+
+static float median(const tof_filter *f)
+{
+    uint16_t v[TOF_FILTER_WINDOW_MAX];
+    uint8_t n = f->fill;
+    memcpy(v, f->ring, n * sizeof(v[0]));
+    for (uint8_t i = 1; i < n; i++)
+        for (uint8_t j = i; j > 0 && v[j - 1] > v[j]; j--) {
+            uint16_t t = v[j]; v[j] = v[j - 1]; v[j - 1] = t;
+        }
+    return (n & 1) ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+/* variance of the median of n readings: pi/2 * var / n for large n */
+static float median_var(const tof_filter *f)
+{
+    float var = f->cfg.noise_mm * f->cfg.noise_mm;
+    return f->fill > 1 ? var * 1.5708f / f->fill : var;
+}
+
+/* state and covariance carried dt seconds ahead, white acceleration noise */
+static void predict(const float x[2], const float p[3], float q, float dt, float xo[2], float po[3])
+{
+    float dt2 = dt * dt;
+    xo[0] = x[0] + x[1] * dt;
+    xo[1] = x[1];
+    po[0] = p[0] + dt * (2.0f * p[1] + dt * p[2]) + q * dt2 * dt2 / 4.0f;
+    po[1] = p[1] + dt * p[2] + q * dt2 * dt / 2.0f;
+    po[2] = p[2] + q * dt2;
+}
+
+static void push(tof_filter *f, uint16_t mm)
+{
+    f->ring[f->head] = mm;
+    f->head = (uint8_t)((f->head + 1) % f->cfg.window);
+    if (f->fill < f->cfg.window) f->fill++;
+}
+
+static void kalman_update(tof_filter *f, float z, float r, uint64_t t_us)
+{
+    if (!f->tracking) {
+        f->x[0] = z;
+        f->x[1] = 0.0f;
+        f->p[0] = r;
+        f->p[1] = 0.0f;
+        f->p[2] = TOF_FILTER_RATE_SD0 * TOF_FILTER_RATE_SD0;
+        f->tracking = 1;
+    } else {
+        float q = f->cfg.accel_mm_s2 * f->cfg.accel_mm_s2;
+        predict(f->x, f->p, q, (float)(t_us - f->t_us) * 1e-6f, f->x, f->p);
+        float s = f->p[0] + r;
+        float k0 = f->p[0] / s, k1 = f->p[1] / s;
+        float y = z - f->x[0];
+        f->x[0] += k0 * y;
+        f->x[1] += k1 * y;
+        f->p[2] -= k1 * f->p[1];
+        f->p[1] *= 1.0f - k0;
+        f->p[0] *= 1.0f - k0;
+    }
+    f->t_us = t_us;
+}
+
+/* Kalman gate on a single reading. Returns 1 to accept it; a second
+ * outlier that agrees with the first restarts the filter from both. */
+static int gate(tof_filter *f, uint16_t mm, uint64_t t_us)
+{
+    if (!f->cfg.kalman || f->cfg.gate_sd <= 0.0f || !f->tracking) return 1;
+
+    float var = f->cfg.noise_mm * f->cfg.noise_mm;
+    float x[2], p[3];
+    predict(f->x, f->p, f->cfg.accel_mm_s2 * f->cfg.accel_mm_s2,
+            (float)(t_us - f->t_us) * 1e-6f, x, p);
+    float lim = f->cfg.gate_sd * sqrtf(p[0] + var);
+    if (fabsf((float)mm - x[0]) <= lim) {
+        f->outlier_mm = -1;
+        return 1;
+    }
+
+    int32_t prev = f->outlier_mm;
+    f->outlier_mm = mm;
+    if (prev < 0 || fabsf((float)(mm - prev)) > f->cfg.gate_sd * sqrtf(2.0f * var)) return 0;
+
+    /* the scene changed: start again from the two readings */
+    uint64_t accepted_us = f->accepted_us;
+    tof_filter_reset(f);
+    f->accepted_us = accepted_us;
+    push(f, (uint16_t)prev);
+    return 1;
+}
+
+int tof_filter_add(tof_filter *f, uint16_t mm, uint8_t status, uint64_t t_us)
+{
+    int ok = status == VL53X_RANGE_VALID && mm < f->cfg.max_mm && gate(f, mm, t_us);
+    f->status = status;     /* after gate(), which may reset the filter */
+    f->accepted = (uint8_t)ok;
+    if (!f->accepted) {
+        f->n_rejected++;
+        return 0;
+    }
+    f->n_accepted++;
+    f->accepted_us = t_us;
+    push(f, mm);
+    if (f->cfg.kalman) kalman_update(f, median(f), median_var(f), t_us);
+    return 1;
+}
+
+void tof_filter_get(const tof_filter *f, uint64_t now_us, tof_estimate *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->status   = f->status;
+    out->accepted = f->accepted;
+    if (!f->fill) return;
+
+    out->valid = now_us <= f->accepted_us || now_us - f->accepted_us <= f->cfg.hold_us;
+    if (f->cfg.kalman && f->tracking) {
+        float x[2], p[3];
+        float dt = now_us > f->t_us ? (float)(now_us - f->t_us) * 1e-6f : 0.0f;
+        predict(f->x, f->p, f->cfg.accel_mm_s2 * f->cfg.accel_mm_s2, dt, x, p);
+        out->mm       = x[0];
+        out->var_mm2  = p[0];
+        out->mm_per_s = x[1];
+        out->t_us     = now_us > f->t_us ? now_us : f->t_us;
+    } else {
+        out->mm      = median(f);
+        out->var_mm2 = median_var(f);
+        out->t_us    = f->accepted_us;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef TOF_FILTER_H
+#define TOF_FILTER_H
+
+#include <stdint.h>
+
+/*
+ * Distance filter for one VL53L0X.
+ *
+ * Each reading goes through three stages:
+ *
+ *   1. validation: the device's range status must be VL53X_RANGE_VALID
+ *      and the distance below max_mm;
+ *   2. a median over the last `window` accepted readings, which removes
+ *      single wild readings the device did not flag;
+ *   3. optionally a constant-velocity Kalman filter over the medians,
+ *      which smooths, tracks the range rate and can predict the distance
+ *      between readings.
+ *
+ * With the Kalman filter on, a reading more than gate_sd standard
+ * deviations from the prediction is rejected as well. Two such readings
+ * in a row that agree with each other mean the scene changed (an obstacle
+ * moved into view): the filter restarts from them.
+ *
+ * The estimate stays valid for hold_us after the last accepted reading.
+ * Fixed size, no allocation. Not thread-safe: feed and read it from one
+ * thread, or copy tof_estimate out under the caller's lock.
+ */
+
+#define TOF_FILTER_WINDOW_MAX 9
+
+typedef struct tof_filter_cfg {
+    uint8_t  window;          /* median of 1..TOF_FILTER_WINDOW_MAX readings */
+    uint8_t  kalman;          /* 1: constant-velocity Kalman after the median */
+    uint16_t max_mm;          /* readings at or beyond are not trusted       */
+    float    noise_mm;        /* standard deviation of one reading           */
+    float    accel_mm_s2;     /* Kalman: how fast the range rate may change  */
+    float    gate_sd;         /* Kalman: reject beyond this, 0 = no gate     */
+    uint32_t hold_us;         /* estimate valid this long after a reading    */
+} tof_filter_cfg;
+
+/* median of 3, Kalman, 2 m, HIGH_SPEED noise */
+#define TOF_FILTER_DEFAULTS {3, 1, 2000, 8.0f, 2000.0f, 4.0f, 200000}
+
+typedef struct tof_estimate {
+    uint8_t  valid;           /* an accepted reading within hold_us          */
+    uint8_t  accepted;        /* the latest reading passed every check       */
+    uint8_t  status;          /* range status of the latest reading          */
+    float    mm;
+    float    var_mm2;         /* variance of mm                              */
+    float    mm_per_s;        /* range rate, Kalman only; < 0 closing        */
+    uint64_t t_us;            /* CLOCK_MONOTONIC time of the estimate        */
+} tof_estimate;
+
+/* Handle for one sensor's filter, do not modify directly */
+typedef struct tof_filter {
+    tof_filter_cfg cfg;
+    uint16_t       ring[TOF_FILTER_WINDOW_MAX];
+    uint8_t        head, fill;
+    uint8_t        tracking;      /* Kalman state initialised            */
+    float          x[2];          /* distance mm, rate mm/s              */
+    float          p[3];          /* covariance: dd, dv, vv              */
+    uint64_t       t_us;          /* time of x                           */
+    uint64_t       accepted_us;   /* last accepted reading               */
+    int32_t        outlier_mm;    /* last gated reading, -1 none         */
+    uint8_t        status;
+    uint8_t        accepted;
+    uint32_t       n_accepted, n_rejected;
+} tof_filter;
+
+void tof_filter_init(tof_filter *f, const tof_filter_cfg *cfg);
+void tof_filter_reset(tof_filter *f);
+
+/* Add a reading taken at t_us; returns 1 if it was accepted */
+int  tof_filter_add(tof_filter *f, uint16_t mm, uint8_t status, uint64_t t_us);
+
+/* Estimate at now_us, predicted forward from the last reading when the
+ * Kalman filter is on */
+void tof_filter_get(const tof_filter *f, uint64_t now_us, tof_estimate *out);
+
+#endif /* TOF_FILTER_H */
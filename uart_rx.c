@@ -0,0 +1,167 @@
+#include "uart_rx.h"
+#include <libpynq.h>
+
+#include <string.h>
+#include <time.h>
+
+#define RX_MASK (UART_RX_SIZE - 1)
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void *reader_thread(void *arg)
+{
+    uart_rx *rx = arg;
+    uint8_t chunk[64];
+
+    while (rx->running) {
+        uint32_t n = 0;
+        while (n < sizeof(chunk) && uart_has_data(rx->uart))
+            chunk[n++] = uart_recv(rx->uart);
+
+        if (n == 0) {
+            struct timespec ts = {0, UART_RX_POLL_US * 1000L};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        pthread_mutex_lock(&rx->lock);
+        for (uint32_t i = 0; i < n; i++) {
+            if (rx->tail - rx->head == UART_RX_SIZE) { rx->dropped++; continue; }
+            rx->buf[rx->tail++ & RX_MASK] = chunk[i];
+        }
+        pthread_cond_broadcast(&rx->data);
+        pthread_mutex_unlock(&rx->lock);
+    }
+    return NULL;
+}
+
+int uart_rx_init(uart_rx *rx, int uart)
+{
+    if (!rx) return UART_RX_ERROR;
+    memset(rx, 0, sizeof(*rx));
+    rx->uart = uart;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_mutex_init(&rx->lock, NULL) || pthread_cond_init(&rx->data, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err) return UART_RX_ERROR;
+
+    rx->running = 1;
+    if (pthread_create(&rx->thread, NULL, reader_thread, rx)) {
+        rx->running = 0;
+        return UART_RX_ERROR;
+    }
+    return UART_RX_OK;
+}
+
+void uart_rx_destroy(uart_rx *rx)
+{
+    if (!rx || !rx->running) return;
+    rx->running = 0;
+    pthread_join(rx->thread, NULL);
+    pthread_cond_destroy(&rx->data);
+    pthread_mutex_destroy(&rx->lock);
+}
+
+uint32_t uart_rx_available(uart_rx *rx)
+{
+    pthread_mutex_lock(&rx->lock);
+    uint32_t n = rx->tail - rx->head;
+    pthread_mutex_unlock(&rx->lock);
+    return n;
+}
+
+/* wait for more data, called with rx->lock held; returns 1 past the deadline */
+static int wait_data(uart_rx *rx, uint64_t deadline_us)
+{
+    if (deadline_us == UART_RX_FOREVER) {
+        pthread_cond_wait(&rx->data, &rx->lock);
+        return 0;
+    }
+    if (time_us() >= deadline_us) return 1;
+    struct timespec ts = {(time_t)(deadline_us / 1000000ULL), (long)(deadline_us % 1000000ULL) * 1000L};
+    pthread_cond_timedwait(&rx->data, &rx->lock, &ts);
+    return 0;
+}
+
+static uint8_t peek(uart_rx *rx, uint32_t offset)
+{
+    return rx->buf[(rx->head + offset) & RX_MASK];
+}
+
+static void copy_out(uart_rx *rx, uint32_t offset, uint8_t *out, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) out[i] = peek(rx, offset + i);
+}
+
+int uart_rx_read(uart_rx *rx, uint8_t *buf, uint32_t len, uint64_t deadline_us)
+{
+    if (len > UART_RX_SIZE) return UART_RX_ERROR;
+    pthread_mutex_lock(&rx->lock);
+    while (rx->tail - rx->head < len) {
+        if (wait_data(rx, deadline_us)) {
+            pthread_mutex_unlock(&rx->lock);
+            return UART_RX_TIMEOUT;
+        }
+    }
+    copy_out(rx, 0, buf, len);
+    rx->head += len;
+    pthread_mutex_unlock(&rx->lock);
+    return UART_RX_OK;
+}
+
+int uart_rx_read_framed(uart_rx *rx, frame_parser *p, uint64_t deadline_us)
+{
+    pthread_mutex_lock(&rx->lock);
+    while (1) {
+        while (rx->head != rx->tail) {
+            if (frame_parser_feed(p, rx->buf[rx->head++ & RX_MASK]) == FRAME_READY) {
+                pthread_mutex_unlock(&rx->lock);
+                return UART_RX_OK;
+            }
+        }
+        if (wait_data(rx, deadline_us)) {
+            pthread_mutex_unlock(&rx->lock);
+            return UART_RX_TIMEOUT;
+        }
+    }
+}
+
+int uart_rx_read_frame(uart_rx *rx, uint8_t *buf, uint32_t max, uint32_t *len,
+                       uint64_t deadline_us)
+{
+    if (max > UART_RX_SIZE - UART_RX_HEADER) max = UART_RX_SIZE - UART_RX_HEADER;
+
+    pthread_mutex_lock(&rx->lock);
+    while (1) {
+        uint32_t avail = rx->tail - rx->head;
+        if (avail >= UART_RX_HEADER) {
+            uint32_t n = ((uint32_t)peek(rx, 0) << 24) | ((uint32_t)peek(rx, 1) << 16) |
+                         ((uint32_t)peek(rx, 2) << 8)  |  (uint32_t)peek(rx, 3);
+            if (n == 0 || n > max) {
+                /* not a header: slide one byte and look again */
+                rx->head++;
+                rx->resyncs++;
+                continue;
+            }
+            if (avail >= UART_RX_HEADER + n) {
+                copy_out(rx, UART_RX_HEADER, buf, n);
+                rx->head += UART_RX_HEADER + n;
+                *len = n;
+                pthread_mutex_unlock(&rx->lock);
+                return UART_RX_OK;
+            }
+        }
+        if (wait_data(rx, deadline_us)) {
+            pthread_mutex_unlock(&rx->lock);
+            return UART_RX_TIMEOUT;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef UART_RX_H
+#define UART_RX_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <libpynq.h>
+
+#include "frame.h"
+
+/*
+ * Buffered UART receive.
+ *
+ * A reader thread drains everything the UART FIFO holds into a ring buffer
+ * each time it wakes; readers block on a condition variable instead of
+ * polling the UART byte by byte. Deadlines are absolute CLOCK_MONOTONIC
+ * times in us, UART_RX_NOWAIT and UART_RX_FOREVER are the two extremes.
+ */
+
+#define UART_RX_SIZE      4096         /* ring buffer bytes, power of two   */
+#define UART_RX_POLL_US   250          /* reader sleep while the FIFO is empty */
+#define UART_RX_HEADER    4            /* big-endian frame length prefix    */
+
+#define UART_RX_NOWAIT    0ULL
+#define UART_RX_FOREVER   UINT64_MAX
+
+#define UART_RX_OK        0
+#define UART_RX_TIMEOUT   1
+#define UART_RX_ERROR     2
+
+/* Handle for one receive path, do not modify directly */
+typedef struct uart_rx {
+    int             uart;
+    uint8_t         buf[UART_RX_SIZE];
+    uint32_t        head, tail;         /* free-running, masked on access */
+    uint64_t        dropped;            /* bytes lost to a full ring      */
+    uint64_t        resyncs;            /* bytes skipped to find a frame  */
+    pthread_mutex_t lock;
+    pthread_cond_t  data;               /* bytes were added               */
+    pthread_t       thread;
+    _Atomic int     running;            /* cleared by uart_rx_destroy     */
+} uart_rx;
+
+/* Start the reader thread on an initialised UART */
+int  uart_rx_init(uart_rx *rx, int uart);
+void uart_rx_destroy(uart_rx *rx);
+
+/* Bytes buffered */
+uint32_t uart_rx_available(uart_rx *rx);
+
+/* Read exactly len bytes; nothing is consumed on timeout */
+int  uart_rx_read(uart_rx *rx, uint8_t *buf, uint32_t len, uint64_t deadline_us);
+
+/*
+ * Read one length-prefixed frame into buf (max payload bytes) and store the
+ * payload length in *len. A header announcing 0 or more than max bytes is
+ * treated as noise and skipped one byte at a time. Nothing is consumed
+ * until the whole frame has arrived.
+ */
+int  uart_rx_read_frame(uart_rx *rx, uint8_t *buf, uint32_t max, uint32_t *len,
+                        uint64_t deadline_us);
+
+/*
+ * Feed buffered bytes to a framed-protocol parser (frame.h) until it holds
+ * a complete, CRC-checked frame. Bytes are consumed as they are parsed.
+ */
+int  uart_rx_read_framed(uart_rx *rx, frame_parser *p, uint64_t deadline_us);
+
+#endif /* UART_RX_H */
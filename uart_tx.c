@@ -0,0 +1,86 @@
+#include "uart_tx.h"
+#include <libpynq.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PAYLOAD(tx) ((tx)->buf + UART_TX_RESERVE)
+
+void uart_tx_init(uart_tx *tx, int uart)
+{
+    tx->uart   = uart;
+    tx->framed = 0;
+    tx->seq    = 0;
+    uart_tx_begin(tx);
+}
+
+void uart_tx_set_framed(uart_tx *tx, int framed)
+{
+    tx->framed = framed;
+}
+
+void uart_tx_begin(uart_tx *tx)
+{
+    tx->len = 0;
+    tx->overflow = 0;
+}
+
+int uart_tx_append(uart_tx *tx, const void *data, uint32_t len)
+{
+    if (len > UART_TX_SIZE - tx->len) {
+        tx->overflow = 1;
+        return UART_TX_FULL;
+    }
+    memcpy(PAYLOAD(tx) + tx->len, data, len);
+    tx->len += len;
+    return UART_TX_OK;
+}
+
+int uart_tx_printf(uart_tx *tx, const char *fmt, ...)
+{
+    uint32_t room = UART_TX_SIZE - tx->len;
+    va_list ap;
+    va_start(ap, fmt);
+    /* vsnprintf needs room for its terminator, which is not sent */
+    int n = vsnprintf((char *)PAYLOAD(tx) + tx->len, room, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (uint32_t)n >= room) {
+        tx->overflow = 1;
+        return UART_TX_FULL;
+    }
+    tx->len += (uint32_t)n;
+    return UART_TX_OK;
+}
+
+const char *uart_tx_payload(uart_tx *tx, uint32_t *len)
+{
+    if (len) *len = tx->len;
+    return (const char *)PAYLOAD(tx);
+}
+
+int uart_tx_flush(uart_tx *tx)
+{
+    if (tx->overflow) {
+        uart_tx_begin(tx);
+        return UART_TX_FULL;
+    }
+    uint8_t *start;
+    uint32_t total;
+    if (tx->framed) {
+        /* the payload already sits where frame_encode puts it */
+        start = tx->buf;
+        total = (uint32_t)frame_encode(start, sizeof(tx->buf), tx->seq++, PAYLOAD(tx), (uint16_t)tx->len);
+    } else {
+        start = PAYLOAD(tx) - UART_TX_HEADER;
+        start[0] = (uint8_t)(tx->len >> 24);
+        start[1] = (uint8_t)(tx->len >> 16);
+        start[2] = (uint8_t)(tx->len >> 8);
+        start[3] = (uint8_t)tx->len;
+        total = UART_TX_HEADER + tx->len;
+    }
+
+    for (uint32_t i = 0; i < total; i++) uart_send(tx->uart, start[i]);
+    uart_tx_begin(tx);
+    return UART_TX_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef UART_TX_H
+#define UART_TX_H
+
+#include <stdint.h>
+#include <libpynq.h>
+
+#include "frame.h"
+
+/*
+ * Buffered UART transmit.
+ *
+ * A frame is assembled in memory and written out in one pass with its
+ * 4-byte big-endian length header, instead of formatting and sending a
+ * line at a time. In framed mode the frame.h header, sequence number and
+ * CRC are used instead.
+ */
+
+#define UART_TX_SIZE    1024           /* largest payload */
+#define UART_TX_HEADER  4
+#define UART_TX_RESERVE FRAME_HEADER   /* room kept in front of the payload */
+
+#define UART_TX_OK      0
+#define UART_TX_FULL    1              /* payload did not fit, frame dropped */
+
+/* Transmit buffer, do not modify directly */
+typedef struct uart_tx {
+    int      uart;
+    uint32_t len;                      /* payload bytes so far     */
+    int      overflow;                 /* an append did not fit    */
+    int      framed;                   /* frame.h format           */
+    uint8_t  seq;                      /* next framed sequence no. */
+    uint8_t  buf[UART_TX_RESERVE + UART_TX_SIZE + FRAME_TRAILER];
+} uart_tx;
+
+void uart_tx_init(uart_tx *tx, int uart);
+
+/* Select the frame.h format (1) or the plain length header (0) */
+void uart_tx_set_framed(uart_tx *tx, int framed);
+
+/* Start a new frame, discarding anything not flushed */
+void uart_tx_begin(uart_tx *tx);
+
+int  uart_tx_append(uart_tx *tx, const void *data, uint32_t len);
+int  uart_tx_printf(uart_tx *tx, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Payload assembled so far (not terminated) */
+const char *uart_tx_payload(uart_tx *tx, uint32_t *len);
+
+/* Fill in the header and send the frame; returns UART_TX_FULL if any
+ * append overflowed, in which case nothing is sent. */
+int  uart_tx_flush(uart_tx *tx);
+
+#endif /* UART_TX_H */
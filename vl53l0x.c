@@ -23,19 +23,22 @@
 
 #include <libpynq.h>
 #include <vl53l0x.h>
+#include <iic_profile.h>
 
+#include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 static uint8_t readReg(vl53x *ptr_s, uint8_t ucAddr);
 static unsigned short readReg16(vl53x *ptr_s, uint8_t ucAddr);
 static void writeReg16(vl53x *ptr_s, uint8_t ucAddr, unsigned short usValue);
 static void writeReg(vl53x *ptr_s, uint8_t ucAddr, uint8_t ucValue);
 static void writeRegList(vl53x *ptr_s, uint8_t *ucList);
-static int initSensor(vl53x *ptr_s, int);
+static int initSensor(vl53x *ptr_s, int, const vl53xCalibration *pCal);
 static int performSingleRefCalibration(vl53x *ptr_s, uint8_t vhv_init_byte);
 static int setMeasurementTimingBudget(vl53x *ptr_s, uint32_t budget_us);
 
@@ -53,6 +56,22 @@ static int setMeasurementTimingBudget(vl53x *ptr_s, uint32_t budget_us);
 typedef enum vcselperiodtype { VcselPeriodPreRange, VcselPeriodFinalRange } vcselPeriodType;
 static int setVcselPulsePeriod(vl53x *ptr_s, vcselPeriodType type, uint8_t period_pclks);
 
+// Ranging presets, after ST's VL53L0X API examples
+typedef struct tagRangingProfile
+{
+  uint32_t budget_us;
+  uint16_t signal_rate_limit; // Q9.7 MCPS
+  uint8_t pre_range_vcsel_pclks, final_range_vcsel_pclks;
+} RangingProfile;
+
+static const RangingProfile profiles[] =
+{
+  [VL53X_PROFILE_DEFAULT]       = { 33000, 32, 14, 10}, // 0.25 MCPS
+  [VL53X_PROFILE_HIGH_SPEED]    = { 20000, 32, 14, 10},
+  [VL53X_PROFILE_HIGH_ACCURACY] = {200000, 32, 14, 10},
+  [VL53X_PROFILE_LONG_RANGE]    = { 33000, 13, 18, 14}, // 0.1 MCPS
+};
+
 typedef struct tagSequenceStepTimeouts
 {
   uint16_t pre_range_vcsel_period_pclks, final_range_vcsel_period_pclks;
@@ -87,6 +106,11 @@ typedef struct tagSequenceStepTimeouts
 #define VL53L0X_MSRC_CONFIG_TIMEOUT_MACROP              0x46
 #define VL53L0X_FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT  0x44
 #define VL53L0X_SYSRANGE_START                          0x00
+#define VL53L0X_SYSRANGE_MODE_SINGLESHOT                0x01
+#define VL53L0X_SYSRANGE_MODE_BACKTOBACK                0x02
+#define VL53L0X_SYSRANGE_MODE_TIMED                     0x04
+#define VL53L0X_SYSTEM_INTERMEASUREMENT_PERIOD          0x04
+#define VL53L0X_OSC_CALIBRATE_VAL                       0xF8
 #define VL53L0X_SYSTEM_SEQUENCE_CONFIG                  0x01
 #define VL53L0X_SYSTEM_INTERRUPT_CONFIG_GPIO            0x0A
 #define VL53L0X_RESULT_INTERRUPT_STATUS                 0x13
@@ -97,12 +121,34 @@ typedef struct tagSequenceStepTimeouts
 
 #define VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS 0x8A
 
+// Polling: sleep until the measurement should be done, then back off from
+// 1/32 to 1/4 of the timing budget between status reads
+#define VL53X_DEFAULT_BUDGET_US   33000
+#define VL53X_MIN_POLL_US         200
+#define VL53X_DEFAULT_TIMEOUT_US  500000  // legacy API bound
+#define VL53X_REF_CAL_US          1000    // expected VHV / phase cal time
+#define VL53X_REF_CAL_TIMEOUT_US  500000
+
+static uint64_t timeUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void sleepUntilUs(uint64_t wake_us)
+{
+  struct timespec ts = {(time_t)(wake_us / 1000000ULL), (long)(wake_us % 1000000ULL) * 1000L};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
 //
 // Set IIC address of a VL53L0X Sensor
 //
 int tofSetAddress(iic_index_t iic, uint8_t addr, uint8_t newAddr)
 {
-  return iic_write_register(iic, addr, VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS, &newAddr, 1);
+  return IIC_WRITE(iic, addr, VL53L0X_REG_I2C_SLAVE_DEVICE_ADDRESS, &newAddr, 1);
 }
 
 //
@@ -112,22 +158,47 @@ int tofSetAddress(iic_index_t iic, uint8_t addr, uint8_t newAddr)
 int tofPing(iic_index_t iic, uint8_t addr)
 {
   uint8_t model;
-  iic_read_register(iic, addr, VL53L0X_REG_IDENTIFICATION_MODEL_ID, &model, 1);
+  IIC_READ(iic, addr, VL53L0X_REG_IDENTIFICATION_MODEL_ID, &model, 1);
   return (model != VL53L0X_EXPECTED_MODEL_ID);
 }
 
+static void resetHandle(vl53x *ptr_s, iic_index_t iic, uint8_t addr)
+{
+  ptr_s->iic_index = iic;
+  ptr_s->baseAddr = addr;
+  ptr_s->continuous = 0;
+  ptr_s->period_ms = 0;
+  ptr_s->period_us = 0;
+  ptr_s->next_ready_us = 0;
+  ptr_s->range_status = 0;
+  memset(&ptr_s->cal, 0, sizeof(ptr_s->cal));
+} /* resetHandle() */
+
 //
 // reads the calibration data and sets the device
 // into auto sensing mode
 //
 int tofInit(vl53x *ptr_s, iic_index_t iic, uint8_t addr, int bLongRange)
 {
-  ptr_s->iic_index = iic;
-  ptr_s->baseAddr = addr;
-	return initSensor(ptr_s, bLongRange); // finally, initialize the magic numbers in the sensor
+  resetHandle(ptr_s, iic, addr);
+	return initSensor(ptr_s, bLongRange, NULL); // finally, initialize the magic numbers in the sensor
 
 } /* tofInit() */
 
+//
+// As tofInit, but with the calibration results of an earlier init
+//
+int tofInitWarm(vl53x *ptr_s, iic_index_t iic, uint8_t addr, int bLongRange,
+                const vl53xCalibration *pCal)
+{
+  resetHandle(ptr_s, iic, addr);
+  if (pCal && (pCal->version != VL53X_CAL_VERSION || pCal->long_range != (bLongRange != 0)))
+    pCal = NULL;
+  if (!pCal)
+    return initSensor(ptr_s, bLongRange, NULL) ? VL53X_ERROR : VL53X_COLD_START;
+  return initSensor(ptr_s, bLongRange, pCal);
+} /* tofInitWarm() */
+
 
 
 //
@@ -136,7 +207,7 @@ int tofInit(vl53x *ptr_s, iic_index_t iic, uint8_t addr, int bLongRange)
 static unsigned short readReg16(vl53x *ptr_s, uint8_t ucAddr)
 {
   uint8_t ucTemp[2];
-  iic_read_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, ucTemp, 2);
+  IIC_READ(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, ucTemp, 2);
 
 	return (unsigned short)((ucTemp[0]<<8) + ucTemp[1]);
 } /* readReg16() */
@@ -148,7 +219,7 @@ static uint8_t readReg(vl53x *ptr_s, uint8_t ucAddr)
 {
   uint8_t ucTemp;
 
-  iic_read_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, &ucTemp, 1);
+  IIC_READ(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, &ucTemp, 1);
 
 	return ucTemp;
 } /* ReadReg() */
@@ -156,14 +227,14 @@ static uint8_t readReg(vl53x *ptr_s, uint8_t ucAddr)
 static void readMulti(vl53x *ptr_s, uint8_t ucAddr, uint8_t *pBuf, int iCount)
 {
 
-  iic_read_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, iCount);
+  IIC_READ(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, iCount);
 
 } /* readMulti() */
 
 static void writeMulti(vl53x *ptr_s, uint8_t ucAddr, uint8_t *pBuf, int iCount)
 {
 
-  iic_write_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, iCount);
+  IIC_WRITE(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, iCount);
 
 } /* writeMulti() */
 //
@@ -176,7 +247,7 @@ static void writeReg16(vl53x *ptr_s, uint8_t ucAddr, unsigned short usValue)
 	pBuf[0] = (uint8_t)(usValue >> 8); // MSB first
 	pBuf[1] = (uint8_t) usValue;
 
-  iic_write_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, 2);
+  IIC_WRITE(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, pBuf, 2);
 } /* writeReg16() */
 //
 // Write a single register/value pair
@@ -184,7 +255,7 @@ static void writeReg16(vl53x *ptr_s, uint8_t ucAddr, unsigned short usValue)
 static void writeReg(vl53x *ptr_s, uint8_t ucAddr, uint8_t ucValue)
 {
 
-  iic_write_register(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, &ucValue, 1);
+  IIC_WRITE(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, &ucValue, 1);
 
 } /* writeReg() */
 
@@ -197,7 +268,7 @@ static void writeRegList(vl53x *ptr_s, uint8_t *ucList)
 
 	while (ucCount)
 	{
-    iic_write_register(ptr_s->iic_index, ptr_s->baseAddr, ucList[0], &(ucList[1]), 1);
+    IIC_WRITE(ptr_s->iic_index, ptr_s->baseAddr, ucList[0], &(ucList[1]), 1);
 		ucList += 2;
 		ucCount--;
 	}
@@ -670,16 +741,52 @@ uint32_t getMeasurementTimingBudget(vl53x *ptr_s)
   return budget_us;
 }
 
+//
+// Wait until (register & mask) is non-zero (bSet = 1) or zero (bSet = 0).
+// Sleeps until ready_us, when the device should be done, then polls with
+// a backoff that doubles from 1/32 to 1/4 of the timing budget. Never
+// sleeps past deadline_us. Returns VL53X_OK, VL53X_TIMEOUT or VL53X_ERROR.
+//
+static int waitForReg(vl53x *ptr_s, uint8_t ucAddr, uint8_t ucMask, int bSet,
+                      uint64_t ready_us, uint64_t deadline_us)
+{
+uint32_t budget_us, step_us, max_step_us;
+uint64_t now_us;
+uint8_t ucTemp;
+
+  budget_us = ptr_s->measurement_timing_budget_us ? ptr_s->measurement_timing_budget_us : VL53X_DEFAULT_BUDGET_US;
+  step_us = budget_us / 32;
+  max_step_us = budget_us / 4;
+  if (step_us < VL53X_MIN_POLL_US) step_us = VL53X_MIN_POLL_US;
+
+  now_us = timeUs();
+  if (ready_us > now_us)
+    sleepUntilUs(ready_us < deadline_us ? ready_us : deadline_us);
+
+  while (1)
+  {
+    if (IIC_READ(ptr_s->iic_index, ptr_s->baseAddr, ucAddr, &ucTemp, 1))
+      return VL53X_ERROR;
+    if (((ucTemp & ucMask) != 0) == (bSet != 0))
+      return VL53X_OK;
+
+    now_us = timeUs();
+    if (now_us >= deadline_us)
+      return VL53X_TIMEOUT;
+    sleepUntilUs((now_us + step_us < deadline_us) ? now_us + step_us : deadline_us);
+    step_us = (step_us * 2 < max_step_us) ? step_us * 2 : max_step_us;
+  }
+} /* waitForReg() */
+
 int performSingleRefCalibration(vl53x *ptr_s, uint8_t vhv_init_byte)
 {
+  uint64_t start_us = timeUs();
   writeReg(ptr_s, VL53L0X_SYSRANGE_START, 0x01 | vhv_init_byte); // VL53L0X_REG_SYSRANGE_MODE_START_STOP
 
-  int iTimeout = 0;
-  while ((readReg(ptr_s, VL53L0X_RESULT_INTERRUPT_STATUS) & 0x07) == 0)
+  if (waitForReg(ptr_s, VL53L0X_RESULT_INTERRUPT_STATUS, 0x07, 1,
+                 start_us + VL53X_REF_CAL_US, start_us + VL53X_REF_CAL_TIMEOUT_US) != VL53X_OK)
   {
-    iTimeout++;
-    sleep_msec(5);
-    if (iTimeout > 100) { return 0; }
+    return 0;
   }
 
   writeReg(ptr_s, VL53L0X_SYSTEM_INTERRUPT_CLEAR, 0x01);
@@ -689,14 +796,73 @@ int performSingleRefCalibration(vl53x *ptr_s, uint8_t vhv_init_byte)
   return 1;
 } /* performSingleRefCalibration() */
 
+//
+// Read (bRead = 1) or write the VHV and phase calibration results. They
+// sit in bits 6..0 of 0xCB and 0xEE, reached after the same page dance
+// as the stop variable.
+//
+static void refCalibrationIo(vl53x *ptr_s, int bRead, uint8_t *pVhv, uint8_t *pPhase)
+{
+  writeReg(ptr_s, 0xFF, 0x01);
+  writeReg(ptr_s, 0x00, 0x00);
+  writeReg(ptr_s, 0xFF, 0x00);
+  if (bRead)
+  {
+    *pVhv = readReg(ptr_s, 0xCB) & 0x7F;
+    *pPhase = readReg(ptr_s, 0xEE) & 0x7F;
+  }
+  else
+  {
+    writeReg(ptr_s, 0xCB, (readReg(ptr_s, 0xCB) & 0x80) | *pVhv);
+    writeReg(ptr_s, 0xEE, (readReg(ptr_s, 0xEE) & 0x80) | *pPhase);
+  }
+  writeReg(ptr_s, 0xFF, 0x01);
+  writeReg(ptr_s, 0x00, 0x01);
+  writeReg(ptr_s, 0xFF, 0x00);
+} /* refCalibrationIo() */
+
+//
+// A stored calibration can only be used on a device that looks like the
+// one it came from, and only if its SPAD map is one initSensor could
+// have produced
+//
+static int calibrationMatches(vl53x *ptr_s, const vl53xCalibration *pCal)
+{
+uint8_t model, revision, ucFirstSPAD, ucSPADsEnabled;
+int i;
+
+  if (tofGetModel(ptr_s, &model, &revision) || model != pCal->model || revision != pCal->revision)
+    return 0;
+  if (pCal->stop_variable != ptr_s->stop_variable)
+    return 0;
+  if (pCal->vhv_settings & 0x80 || pCal->phase_cal & 0x80)
+    return 0;
+  ucFirstSPAD = (pCal->spad_is_aperture) ? 12: 0;
+  ucSPADsEnabled = 0;
+  for (i=0; i<48; i++)
+  {
+    if (pCal->ref_spad_map[i>>3] & (1<<(i & 7)))
+    {
+      if (i < ucFirstSPAD)
+        return 0;
+      ucSPADsEnabled++;
+    }
+  }
+  // fewer when the initial map had fewer good SPADs than NVM asked for
+  return ucSPADsEnabled > 0 && ucSPADsEnabled <= pCal->spad_count;
+} /* calibrationMatches() */
+
 //
 // Initialize the vl53l0x
+// With pCal the SPAD and reference calibration results are written back
+// instead of measured; returns VL53X_COLD_START if pCal does not match the
+// device and the full sequence was run instead.
 //
-int initSensor(vl53x *ptr_s, int bLongRangeMode)
+int initSensor(vl53x *ptr_s, int bLongRangeMode, const vl53xCalibration *pCal)
 {
   uint8_t spad_count=0, spad_type_is_aperture=0, ref_spad_map[6];
-  uint8_t ucFirstSPAD, ucSPADsEnabled;
-  int i;
+  uint8_t ucFirstSPAD, ucSPADsEnabled, vhv, phase;
+  int i, bWarm;
 
 // set 2.8V mode
   writeReg(ptr_s, VL53L0X_VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV,
@@ -705,29 +871,40 @@ int initSensor(vl53x *ptr_s, int bLongRangeMode)
   writeRegList(ptr_s, ucI2CMode);
   ptr_s->stop_variable = readReg(ptr_s, 0x91);
   writeRegList(ptr_s, ucI2CMode2);
+  bWarm = (pCal != NULL) && calibrationMatches(ptr_s, pCal);
   // disable SIGNAL_RATE_MSRC (bit 1) and SIGNAL_RATE_PRE_RANGE (bit 4) limit checks
   writeReg(ptr_s, VL53L0X_REG_MSRC_CONFIG_CONTROL, readReg(ptr_s, VL53L0X_REG_MSRC_CONFIG_CONTROL) | 0x12);
   // Q9.7 fixed point format (9 integer bits, 7 fractional bits)
   writeReg16(ptr_s, VL53L0X_FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT, 32); // 0.25
   writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0xFF);
-  getSpadInfo(ptr_s, &spad_count, &spad_type_is_aperture);
-  readMulti(ptr_s, VL53L0X_GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
-  //printf("initial spad map: %02x,%02x,%02x,%02x,%02x,%02x\n", ref_spad_map[0], ref_spad_map[1], ref_spad_map[2], ref_spad_map[3], ref_spad_map[4], ref_spad_map[5]);
-  writeRegList(ptr_s, ucSPAD);
-  ucFirstSPAD = (spad_type_is_aperture) ? 12: 0;
-  ucSPADsEnabled = 0;
-// clear bits for unused SPADs
-  for (i=0; i<48; i++)
+  if (bWarm)
   {
-    if (i < ucFirstSPAD || ucSPADsEnabled == spad_count)
-    {
-      ref_spad_map[i>>3] &= ~(1<<(i & 7));
-    }
-    else if (ref_spad_map[i>>3] & (1<< (i & 7)))
+    spad_count = pCal->spad_count;
+    spad_type_is_aperture = pCal->spad_is_aperture;
+    memcpy(ref_spad_map, pCal->ref_spad_map, 6);
+    writeRegList(ptr_s, ucSPAD);
+  }
+  else
+  {
+    getSpadInfo(ptr_s, &spad_count, &spad_type_is_aperture);
+    readMulti(ptr_s, VL53L0X_GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
+    //printf("initial spad map: %02x,%02x,%02x,%02x,%02x,%02x\n", ref_spad_map[0], ref_spad_map[1], ref_spad_map[2], ref_spad_map[3], ref_spad_map[4], ref_spad_map[5]);
+    writeRegList(ptr_s, ucSPAD);
+    ucFirstSPAD = (spad_type_is_aperture) ? 12: 0;
+    ucSPADsEnabled = 0;
+  // clear bits for unused SPADs
+    for (i=0; i<48; i++)
     {
-      ucSPADsEnabled++;
-    }
-  } // for i
+      if (i < ucFirstSPAD || ucSPADsEnabled == spad_count)
+      {
+        ref_spad_map[i>>3] &= ~(1<<(i & 7));
+      }
+      else if (ref_spad_map[i>>3] & (1<< (i & 7)))
+      {
+        ucSPADsEnabled++;
+      }
+    } // for i
+  }
   writeMulti(ptr_s, VL53L0X_GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
   //printf("final spad map: %02x,%02x,%02x,%02x,%02x,%02x\n", ref_spad_map[0], ref_spad_map[1], ref_spad_map[2], ref_spad_map[3], ref_spad_map[4], ref_spad_map[5]);
 
@@ -749,45 +926,75 @@ int initSensor(vl53x *ptr_s, int bLongRangeMode)
   ptr_s->measurement_timing_budget_us = getMeasurementTimingBudget(ptr_s);
   writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0xe8);
   setMeasurementTimingBudget(ptr_s, ptr_s->measurement_timing_budget_us);
-  writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0x01);
 
-  if (!performSingleRefCalibration(ptr_s, 0x40)) { return 1; }
-  writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0x02);
-  if (!performSingleRefCalibration(ptr_s, 0x00)) { return 1; }
-  writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0xe8);
-  return 0;
+  if (bWarm)
+  {
+    vhv = pCal->vhv_settings;
+    phase = pCal->phase_cal;
+    refCalibrationIo(ptr_s, 0, &vhv, &phase);
+  }
+  else
+  {
+    writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0x01);
+    if (!performSingleRefCalibration(ptr_s, 0x40)) { return 1; }
+    writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0x02);
+    if (!performSingleRefCalibration(ptr_s, 0x00)) { return 1; }
+    writeReg(ptr_s, VL53L0X_SYSTEM_SEQUENCE_CONFIG, 0xe8);
+    refCalibrationIo(ptr_s, 1, &vhv, &phase);
+  }
+
+  ptr_s->cal.version = VL53X_CAL_VERSION;
+  if (tofGetModel(ptr_s, &ptr_s->cal.model, &ptr_s->cal.revision)) { return 1; }
+  ptr_s->cal.stop_variable = ptr_s->stop_variable;
+  ptr_s->cal.long_range = (bLongRangeMode != 0);
+  ptr_s->cal.spad_count = spad_count;
+  ptr_s->cal.spad_is_aperture = (spad_type_is_aperture != 0);
+  memcpy(ptr_s->cal.ref_spad_map, ref_spad_map, 6);
+  ptr_s->cal.vhv_settings = vhv;
+  ptr_s->cal.phase_cal = phase;
+  return (pCal != NULL && !bWarm) ? VL53X_COLD_START : VL53X_OK;
 } /* initSensor() */
 
-uint16_t readRangeContinuousMillimeters(vl53x *ptr_s)
+//
+// Wait for a measurement expected at ready_us, read it and clear the
+// interrupt
+//
+static int readRangeUntil(vl53x *ptr_s, uint64_t ready_us, uint64_t deadline_us, uint16_t *mm)
 {
-int iTimeout = 0;
-uint16_t range;
+uint8_t ucTemp[12];
 
-  while ((readReg(ptr_s, VL53L0X_RESULT_INTERRUPT_STATUS) & 0x07) == 0)
-  {
-    iTimeout++;
-    sleep_msec(50);
-    if (iTimeout > 50)
-    {
-      return -1;
-    }
-  }
+  int err = waitForReg(ptr_s, VL53L0X_RESULT_INTERRUPT_STATUS, 0x07, 1, ready_us, deadline_us);
+  if (err != VL53X_OK)
+    return err;
 
   // assumptions: Linearity Corrective Gain is 1000 (default);
   // fractional ranging is not enabled
-  range = readReg16(ptr_s, VL53L0X_RESULT_RANGE_STATUS + 10);
+  // status and range in one burst: 0x14 .. 0x1F
+  readMulti(ptr_s, VL53L0X_RESULT_RANGE_STATUS, ucTemp, 12);
+  ptr_s->range_status = (ucTemp[0] & 0x78) >> 3; // bits 6:3, as in ST's driver
+  *mm = (uint16_t)((ucTemp[10] << 8) + ucTemp[11]);
 
   writeReg(ptr_s, VL53L0X_SYSTEM_INTERRUPT_CLEAR, 0x01);
 
+  ptr_s->next_ready_us = timeUs() + ptr_s->period_us;
+  return VL53X_OK;
+} /* readRangeUntil() */
+
+uint16_t readRangeContinuousMillimeters(vl53x *ptr_s)
+{
+uint16_t range;
+
+  if (readRangeUntil(ptr_s, ptr_s->next_ready_us, timeUs() + VL53X_DEFAULT_TIMEOUT_US, &range) != VL53X_OK)
+    return -1;
+
   return range;
 }
 //
-// Read the current distance in mm
+// Restore the stop variable captured during init; needed before every
+// single-shot or continuous start
 //
-uint32_t tofReadDistance(vl53x *sensor)
+static void writeStopVariable(vl53x *sensor)
 {
-int iTimeout;
-
   writeReg(sensor, 0x80, 0x01);
   writeReg(sensor, 0xFF, 0x01);
   writeReg(sensor, 0x00, 0x00);
@@ -795,24 +1002,203 @@ int iTimeout;
   writeReg(sensor, 0x00, 0x01);
   writeReg(sensor, 0xFF, 0x00);
   writeReg(sensor, 0x80, 0x00);
+} /* writeStopVariable() */
+
+//
+// Read the current distance in mm
+//
+uint32_t tofReadDistance(vl53x *sensor)
+{
+uint16_t range;
+
+  if (tofReadDistanceUntil(sensor, timeUs() + VL53X_DEFAULT_TIMEOUT_US, &range) != VL53X_OK)
+    return -1;
+
+  return range;
+
+} /* tofReadDistance() */
+
+//
+// Read the current distance in mm, giving up at deadline_us
+//
+int tofReadDistanceUntil(vl53x *sensor, uint64_t deadline_us, uint16_t *mm)
+{
+uint64_t start_us;
+int err;
 
-  writeReg(sensor, VL53L0X_SYSRANGE_START, 0x01);
+  if (sensor->continuous)
+    return readRangeUntil(sensor, sensor->next_ready_us, deadline_us, mm);
+
+  writeStopVariable(sensor);
+
+  start_us = timeUs();
+  writeReg(sensor, VL53L0X_SYSRANGE_START, VL53L0X_SYSRANGE_MODE_SINGLESHOT);
 
   // "Wait until start bit has been cleared"
-  iTimeout = 0;
-  while (readReg(sensor, VL53L0X_SYSRANGE_START) & 0x01)
+  err = waitForReg(sensor, VL53L0X_SYSRANGE_START, 0x01, 0, start_us, deadline_us);
+  if (err != VL53X_OK)
+    return err;
+
+  return readRangeUntil(sensor, start_us + sensor->measurement_timing_budget_us, deadline_us, mm);
+
+} /* tofReadDistanceUntil() */
+
+//
+// Start continuous ranging; period_ms == 0 selects back-to-back mode
+// based on VL53L0X_StartMeasurement()
+//
+int tofStartContinuous(vl53x *sensor, uint32_t period_ms)
+{
+uint8_t ucTemp[4];
+
+  writeStopVariable(sensor);
+
+  sensor->period_ms = period_ms;
+  sensor->period_us = sensor->measurement_timing_budget_us;
+  if (period_ms * 1000 > sensor->period_us)
+    sensor->period_us = period_ms * 1000;
+
+  if (period_ms != 0)
   {
-    iTimeout++;
-    sleep_msec(50);
-    if (iTimeout > 50)
-    {
-      return -1;
-    }
+    // timed mode: the period register counts oscillator ticks
+    uint16_t osc_calibrate_val = readReg16(sensor, VL53L0X_OSC_CALIBRATE_VAL);
+    if (osc_calibrate_val != 0)
+      period_ms *= osc_calibrate_val;
+
+    ucTemp[0] = (uint8_t)(period_ms >> 24); // MSB first
+    ucTemp[1] = (uint8_t)(period_ms >> 16);
+    ucTemp[2] = (uint8_t)(period_ms >> 8);
+    ucTemp[3] = (uint8_t) period_ms;
+    writeMulti(sensor, VL53L0X_SYSTEM_INTERMEASUREMENT_PERIOD, ucTemp, 4);
+    writeReg(sensor, VL53L0X_SYSRANGE_START, VL53L0X_SYSRANGE_MODE_TIMED);
+  }
+  else
+  {
+    writeReg(sensor, VL53L0X_SYSRANGE_START, VL53L0X_SYSRANGE_MODE_BACKTOBACK);
   }
 
+  sensor->continuous = 1;
+  // first result after one budget, then one per period
+  sensor->next_ready_us = timeUs() + sensor->measurement_timing_budget_us;
+  return 0;
+} /* tofStartContinuous() */
+
+//
+// Stop continuous ranging
+// based on VL53L0X_StopMeasurement()
+//
+int tofStopContinuous(vl53x *sensor)
+{
+  // a single-shot request ends back-to-back and timed ranging
+  writeReg(sensor, VL53L0X_SYSRANGE_START, VL53L0X_SYSRANGE_MODE_SINGLESHOT);
+
+  writeReg(sensor, 0xFF, 0x01);
+  writeReg(sensor, 0x00, 0x00);
+  writeReg(sensor, 0x91, 0x00);
+  writeReg(sensor, 0x00, 0x01);
+  writeReg(sensor, 0xFF, 0x00);
+
+  sensor->continuous = 0;
+  return 0;
+} /* tofStopContinuous() */
+
+//
+// Wait for and read the next continuous measurement
+//
+uint32_t tofReadContinuous(vl53x *sensor)
+{
   return readRangeContinuousMillimeters(sensor);
+} /* tofReadContinuous() */
 
-} /* tofReadDistance() */
+//
+// Non-blocking read of a continuous measurement
+//
+int tofPollContinuous(vl53x *sensor, uint16_t *mm)
+{
+uint8_t ucTemp[2];
+
+  // interrupt status, and the range status right behind it
+  if (IIC_READ(sensor->iic_index, sensor->baseAddr, VL53L0X_RESULT_INTERRUPT_STATUS, ucTemp, 2))
+    return VL53X_ERROR;
+  if ((ucTemp[0] & 0x07) == 0)
+    return VL53X_PENDING;
+  sensor->range_status = (ucTemp[1] & 0x78) >> 3;
+
+  if (IIC_READ(sensor->iic_index, sensor->baseAddr, VL53L0X_RESULT_RANGE_STATUS + 10, ucTemp, 2))
+    return VL53X_ERROR;
+  *mm = (uint16_t)((ucTemp[0] << 8) + ucTemp[1]);
+
+  writeReg(sensor, VL53L0X_SYSTEM_INTERRUPT_CLEAR, 0x01);
+  sensor->next_ready_us = timeUs() + sensor->period_us;
+  return VL53X_OK;
+} /* tofPollContinuous() */
+
+//
+// Change the measurement timing budget
+//
+int tofSetTimingBudget(vl53x *sensor, uint32_t budget_us)
+{
+uint8_t bWasContinuous = sensor->continuous;
+uint32_t period_ms = sensor->period_ms;
+int rc;
+
+  if (bWasContinuous)
+    tofStopContinuous(sensor);
+
+  rc = setMeasurementTimingBudget(sensor, budget_us) ? 0 : 1;
+
+  if (bWasContinuous)
+    tofStartContinuous(sensor, period_ms);
+  return rc;
+} /* tofSetTimingBudget() */
+
+//
+// Range status of the last measurement (cached, no bus traffic)
+//
+uint8_t tofGetRangeStatus(vl53x *sensor)
+{
+  return sensor->range_status;
+} /* tofGetRangeStatus() */
+
+//
+// Current measurement timing budget (cached, no bus traffic)
+//
+uint32_t tofGetTimingBudget(vl53x *sensor)
+{
+  return sensor->measurement_timing_budget_us;
+} /* tofGetTimingBudget() */
+
+//
+// Switch ranging preset without a full re-init. The VCSEL periods are only
+// rewritten when they change, as each change runs a phase calibration.
+//
+int tofSetProfile(vl53x *sensor, vl53xProfile profile)
+{
+const RangingProfile *p;
+uint8_t bWasContinuous = sensor->continuous;
+uint32_t period_ms = sensor->period_ms;
+int rc = 0;
+
+  if ((unsigned)profile >= sizeof(profiles) / sizeof(profiles[0]))
+    return 1;
+  p = &profiles[profile];
+
+  if (bWasContinuous)
+    tofStopContinuous(sensor);
+
+  writeReg16(sensor, VL53L0X_FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT, p->signal_rate_limit);
+
+  if (((readReg(sensor, VL53L0X_PRE_RANGE_CONFIG_VCSEL_PERIOD) + 1) << 1) != p->pre_range_vcsel_pclks)
+    rc |= !setVcselPulsePeriod(sensor, VcselPeriodPreRange, p->pre_range_vcsel_pclks);
+  if (((readReg(sensor, VL53L0X_FINAL_RANGE_CONFIG_VCSEL_PERIOD) + 1) << 1) != p->final_range_vcsel_pclks)
+    rc |= !setVcselPulsePeriod(sensor, VcselPeriodFinalRange, p->final_range_vcsel_pclks);
+
+  rc |= !setMeasurementTimingBudget(sensor, p->budget_us);
+
+  if (bWasContinuous)
+    tofStartContinuous(sensor, period_ms);
+  return rc;
+} /* tofSetProfile() */
 
 int tofGetModel(vl53x *sensor, uint8_t *model, uint8_t *revision)
 {
@@ -821,7 +1207,7 @@ int i;
 
 	if (model)
 	{
-		i = iic_read_register(sensor->iic_index, sensor->baseAddr, VL53L0X_REG_IDENTIFICATION_MODEL_ID, ucTemp, 1);
+		i = IIC_READ(sensor->iic_index, sensor->baseAddr, VL53L0X_REG_IDENTIFICATION_MODEL_ID, ucTemp, 1);
 		if (i == 0) //0 on succes aka no error
 			*model = ucTemp[0];
     else
@@ -829,7 +1215,7 @@ int i;
 	}
 	if (revision)
 	{
-      i = iic_read_register(sensor->iic_index, sensor->baseAddr, VL53L0X_REG_IDENTIFICATION_REVISION_ID, ucTemp, 1);
+      i = IIC_READ(sensor->iic_index, sensor->baseAddr, VL53L0X_REG_IDENTIFICATION_REVISION_ID, ucTemp, 1);
 		if (i == 0)
 			*revision = ucTemp[0];
     else
@@ -838,3 +1224,83 @@ int i;
 	return 0;
 
 } /* tofGetModel() */
+
+//
+// Calibration of the last init (cached, no bus traffic)
+//
+int tofGetCalibration(vl53x *sensor, vl53xCalibration *cal)
+{
+  if (sensor->cal.version != VL53X_CAL_VERSION)
+    return 1;
+  *cal = sensor->cal;
+  return 0;
+} /* tofGetCalibration() */
+
+//
+// File layout: "VL53", the struct, then the two's complement of
+// the byte sum of both, so a valid file sums to zero
+//
+static const uint8_t ucCalMagic[4] = {'V', 'L', '5', '3'};
+
+static uint8_t calChecksum(const vl53xCalibration *cal)
+{
+const uint8_t *p = (const uint8_t *)cal;
+uint8_t sum = 0;
+unsigned int i;
+
+  for (i=0; i<sizeof(ucCalMagic); i++)
+    sum += ucCalMagic[i];
+  for (i=0; i<sizeof(*cal); i++)
+    sum += p[i];
+  return (uint8_t)-sum;
+} /* calChecksum() */
+
+int tofSaveCalibration(const vl53xCalibration *cal, const char *path)
+{
+char tmp[256];
+uint8_t ucSum = calChecksum(cal);
+FILE *f;
+int bad;
+
+  if (cal->version != VL53X_CAL_VERSION)
+    return 1;
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    return 1;
+  f = fopen(tmp, "wb");
+  if (!f)
+    return 1;
+  bad = fwrite(ucCalMagic, sizeof(ucCalMagic), 1, f) != 1;
+  bad |= fwrite(cal, sizeof(*cal), 1, f) != 1;
+  bad |= fwrite(&ucSum, 1, 1, f) != 1;
+  bad |= fflush(f) != 0 || fsync(fileno(f)) != 0;
+  bad |= fclose(f) != 0;
+  if (bad || rename(tmp, path) != 0)
+  {
+    unlink(tmp);
+    return 1;
+  }
+  return 0;
+} /* tofSaveCalibration() */
+
+int tofLoadCalibration(vl53xCalibration *cal, const char *path)
+{
+uint8_t ucMagic[sizeof(ucCalMagic)], ucSum;
+FILE *f;
+int bad;
+
+  f = fopen(path, "rb");
+  if (!f)
+    return 1;
+  bad = fread(ucMagic, sizeof(ucMagic), 1, f) != 1;
+  bad |= fread(cal, sizeof(*cal), 1, f) != 1;
+  bad |= fread(&ucSum, 1, 1, f) != 1;
+  bad |= fgetc(f) != EOF;
+  fclose(f);
+  if (bad || memcmp(ucMagic, ucCalMagic, sizeof(ucMagic)) != 0 ||
+      ucSum != calChecksum(cal) || cal->version != VL53X_CAL_VERSION)
+  {
+    memset(cal, 0, sizeof(*cal));
+    return 1;
+  }
+  return 0;
+} /* tofLoadCalibration() */
@@ -32,6 +32,50 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#define VL53X_OK 0
+#define VL53X_ERROR 1
+#define VL53X_PENDING 2 //No new measurement yet
+#define VL53X_TIMEOUT 3 //Deadline passed before the measurement completed
+#define VL53X_COLD_START 4 //Stored calibration not used, full init done instead
+
+#define VL53X_RANGE_VALID 11 //Range status of a good measurement
+#define VL53X_OUT_OF_RANGE_MM 8190 //Distance reported when no target was found
+
+/**
+ * @brief Ranging presets for `tofSetProfile`
+ * DEFAULT       33ms budget
+ * HIGH_SPEED    20ms budget, ~1.2x the noise of DEFAULT
+ * HIGH_ACCURACY 200ms budget
+ * LONG_RANGE    33ms budget, lower signal limit and longer VCSEL pulses
+ */
+typedef enum _vl53_profile_ {
+    VL53X_PROFILE_DEFAULT,
+    VL53X_PROFILE_HIGH_SPEED,
+    VL53X_PROFILE_HIGH_ACCURACY,
+    VL53X_PROFILE_LONG_RANGE
+} vl53xProfile;
+
+#define VL53X_CAL_VERSION 1
+
+/**
+ * @brief Per-device results of the calibration `tofInit` runs
+ * Reference SPADs (from NVM and the SPAD map), the VHV and phase
+ * calibration, and what identifies the device they belong to. All bytes,
+ * so the file layout is the struct.
+ */
+typedef struct _vl53_calibration_ {
+    uint8_t version; //VL53X_CAL_VERSION, 0 = no calibration
+    uint8_t model;
+    uint8_t revision;
+    uint8_t stop_variable; //Per-part value, read on every init
+    uint8_t long_range; //bLongRange the calibration was run with
+    uint8_t spad_count;
+    uint8_t spad_is_aperture;
+    uint8_t ref_spad_map[6]; //Final GLOBAL_CONFIG_SPAD_ENABLES_REF_0..5
+    uint8_t vhv_settings;
+    uint8_t phase_cal;
+} vl53xCalibration;
+
 /**
  * @brief Internal type, do not modify directly. 
  */
@@ -40,6 +84,12 @@ typedef struct _vl53_sensor_ {
     uint8_t baseAddr;
     uint8_t stop_variable;
     uint32_t measurement_timing_budget_us;
+    uint8_t continuous; //1 while continuous ranging is running
+    uint32_t period_ms; //Requested continuous period, 0 = back-to-back
+    uint32_t period_us; //Time between continuous measurements
+    uint64_t next_ready_us; //When the next measurement should be done
+    uint8_t range_status; //Of the last measurement, VL53X_RANGE_VALID if good
+    vl53xCalibration cal; //Of the last init
 } vl53x;
 
 /**
@@ -70,6 +120,54 @@ extern int tofPing(iic_index_t iic, uint8_t addr);
  */
 extern int tofInit(vl53x *sensor, iic_index_t iic, uint8_t addr, int bLongRange);
 
+/**
+ * @brief Initialize the VL53L0X Sensor from a stored calibration
+ * Skips the NVM SPAD read, the reference SPAD selection and the VHV and
+ * phase calibrations, and writes the stored results instead. The tuning
+ * registers are still loaded, as the device forgets them at power off.
+ * Falls back to `tofInit` when `cal` is NULL, was taken in the other range
+ * mode, or the model, revision or stop variable of the device differ.
+ * @note The stop variable is a per-part value but not a serial number;
+ * delete the stored calibration after swapping sensors. VHV drifts with
+ * temperature: recalibrate when the robot moves to a different climate.
+ * @param sensor Handle to the sensor.
+ * @param iic IIC Index
+ * @param addr IIC Address of the sensor
+ * @param bLongRange as for `tofInit`
+ * @param cal calibration from `tofGetCalibration` or `tofLoadCalibration`
+ * @return VL53X_OK after a warm init, VL53X_COLD_START after a successful
+ * full init (store the new calibration), VL53X_ERROR on error
+ */
+extern int tofInitWarm(vl53x *sensor, iic_index_t iic, uint8_t addr, int bLongRange,
+                       const vl53xCalibration *cal);
+
+/**
+ * @brief Calibration of the last successful init
+ * @param sensor Handle to the sensor.
+ * @param cal pointer to store the calibration
+ * @return 0 if successful, 1 if the sensor was not initialised
+ */
+extern int tofGetCalibration(vl53x *sensor, vl53xCalibration *cal);
+
+/**
+ * @brief Write a calibration to a file
+ * Written to a temporary file and renamed, so a power loss leaves the old
+ * file intact.
+ * @param cal calibration to store
+ * @param path file name
+ * @return 0 if successful, 1 on error
+ */
+extern int tofSaveCalibration(const vl53xCalibration *cal, const char *path);
+
+/**
+ * @brief Read a calibration written by `tofSaveCalibration`
+ * @param cal pointer to store the calibration
+ * @param path file name
+ * @return 0 if successful, 1 if the file is missing, damaged or from
+ * another version
+ */
+extern int tofLoadCalibration(vl53xCalibration *cal, const char *path);
+
 /**
  * @brief Read the model and revision of the VL53L0X Sensor
  * @param sensor Handle to the sensor.
@@ -83,8 +181,91 @@ extern int tofGetModel(vl53x *sensor, uint8_t *model, uint8_t *revision);
  * @brief Read current distance in mm
  * @param sensor Handle to the sensor.
  * @returns distance in mm
+ * @note In continuous mode this returns the next completed measurement
+ * instead of triggering a single shot.
  */
 extern uint32_t tofReadDistance(vl53x *sensor);
 
+/**
+ * @brief Read current distance in mm with a bound on the waiting time
+ * Sleeps until the measurement is due from the timing budget, then polls
+ * with a short backoff.
+ * @param sensor Handle to the sensor.
+ * @param deadline_us absolute CLOCK_MONOTONIC time in microseconds
+ * @param mm pointer to store the distance in mm
+ * @return VL53X_OK, VL53X_TIMEOUT if the deadline passed, VL53X_ERROR on
+ * bus error
+ */
+extern int tofReadDistanceUntil(vl53x *sensor, uint64_t deadline_us, uint16_t *mm);
+
+/**
+ * @brief Start continuous ranging
+ * @param sensor Handle to the sensor.
+ * @param period_ms 0 => back-to-back (a new measurement as soon as the
+ * previous one ends) or the inter-measurement period in timed mode
+ * @return 0 if successful, 1 on error
+ */
+extern int tofStartContinuous(vl53x *sensor, uint32_t period_ms);
+
+/**
+ * @brief Stop continuous ranging
+ * @param sensor Handle to the sensor.
+ * @return 0 if successful, 1 on error
+ */
+extern int tofStopContinuous(vl53x *sensor);
+
+/**
+ * @brief Wait for and read the next continuous measurement in mm
+ * @param sensor Handle to the sensor.
+ * @returns distance in mm
+ */
+extern uint32_t tofReadContinuous(vl53x *sensor);
+
+/**
+ * @brief Non-blocking read of a continuous measurement
+ * @param sensor Handle to the sensor.
+ * @param mm pointer to store the distance in mm
+ * @return VL53X_OK with a new measurement, VL53X_PENDING if none is ready,
+ * VL53X_ERROR on bus error
+ */
+extern int tofPollContinuous(vl53x *sensor, uint16_t *mm);
+
+/**
+ * @brief Set the measurement timing budget
+ * Longer budgets lower the noise by sqrt(budget ratio); minimum 20000us.
+ * @param sensor Handle to the sensor.
+ * @param budget_us timing budget in microseconds
+ * @return 0 if successful, 1 on error
+ * @note Continuous ranging is restarted with the new budget.
+ */
+extern int tofSetTimingBudget(vl53x *sensor, uint32_t budget_us);
+
+/**
+ * @brief Range status of the last measurement read
+ * The device's RESULT_RANGE_STATUS error code: VL53X_RANGE_VALID for a
+ * good range; 1 sigma, 2 signal and 3 minimum range fail, 4 phase fail
+ * (no target, with VL53X_OUT_OF_RANGE_MM) and others mean the distance
+ * should not be trusted.
+ * @param sensor Handle to the sensor.
+ * @returns the status, read together with the distance
+ */
+extern uint8_t tofGetRangeStatus(vl53x *sensor);
+
+/**
+ * @brief Get the measurement timing budget in microseconds
+ * @param sensor Handle to the sensor.
+ * @returns the budget the sensor was last configured with
+ */
+extern uint32_t tofGetTimingBudget(vl53x *sensor);
+
+/**
+ * @brief Switch to a ranging preset without re-initialising
+ * @param sensor Handle to the sensor.
+ * @param profile one of vl53xProfile
+ * @return 0 if successful, 1 on error
+ * @note Continuous ranging is restarted with the new settings.
+ */
+extern int tofSetProfile(vl53x *sensor, vl53xProfile profile);
+
 
 #endif // _TOFLIB_H